@@ -0,0 +1,157 @@
+#pragma once
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace tk
+{
+    // logical cpu ids
+    using CpuSet = std::vector<int>;
+
+    // parses the kernel's cpulist format ("0-3,8,10-11")
+    inline CpuSet ParseCpuList(std::string_view list)
+    {
+        CpuSet cpus;
+        while (!list.empty()) {
+            const auto comma = list.find(',');
+            const auto item = list.substr(0, comma);
+            list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+            if (item.empty() || item == "\n") {
+                continue;
+            }
+            const auto dash = item.find('-');
+            const auto first = std::stoi(std::string{ item.substr(0, dash) });
+            const auto last = dash == std::string_view::npos ? first : std::stoi(std::string{ item.substr(dash + 1) });
+            if (first < 0 || last < first) {
+                throw std::invalid_argument{ "bad cpu list: " + std::string{ item } };
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    // online logical cpus with their physical core, package and NUMA node, read from
+    // /sys/devices/system/cpu; elsewhere (or when sysfs is unreadable) every hardware
+    // thread is reported as its own core on node 0
+    class CpuTopology
+    {
+    public:
+        struct Cpu
+        {
+            int id;
+            int core;
+            int package;
+            int node;
+        };
+
+        static CpuTopology Read()
+        {
+            namespace fs = std::filesystem;
+            const fs::path root = "/sys/devices/system/cpu";
+            CpuTopology topology;
+            std::ifstream online{ root / "online" };
+            std::string list;
+            if (online && std::getline(online, list)) {
+                for (const auto id : ParseCpuList(list)) {
+                    const auto dir = root / ("cpu" + std::to_string(id));
+                    Cpu cpu{ .id = id, .core = ReadInt_(dir / "topology/core_id", id),
+                        .package = ReadInt_(dir / "topology/physical_package_id", 0), .node = 0 };
+                    std::error_code ec;
+                    for (const auto& entry : fs::directory_iterator{ dir, ec }) {
+                        const auto name = entry.path().filename().string();
+                        if (name.starts_with("node") && name.size() > 4) {
+                            cpu.node = std::stoi(name.substr(4));
+                        }
+                    }
+                    topology.cpus_.push_back(cpu);
+                }
+            }
+            if (topology.cpus_.empty()) {
+                const auto n = int(std::max(std::thread::hardware_concurrency(), 1u));
+                for (int id = 0; id < n; id++) {
+                    topology.cpus_.push_back({ .id = id, .core = id, .package = 0, .node = 0 });
+                }
+            }
+            return topology;
+        }
+        const std::vector<Cpu>& Cpus() const
+        {
+            return cpus_;
+        }
+        // one logical cpu (the lowest-numbered SMT sibling) per physical core, ordered so
+        // that a prefix of the list fills one NUMA node before moving on to the next
+        CpuSet PhysicalCores() const
+        {
+            std::map<std::tuple<int, int, int>, int> firstSibling;
+            for (const auto& cpu : cpus_) {
+                const auto [it, isNew] = firstSibling.try_emplace({ cpu.node, cpu.package, cpu.core }, cpu.id);
+                if (!isNew) {
+                    it->second = std::min(it->second, cpu.id);
+                }
+            }
+            CpuSet cores;
+            for (const auto& [key, id] : firstSibling) {
+                cores.push_back(id);
+            }
+            return cores;
+        }
+        // every logical cpu whose physical core has none of its siblings in taken
+        CpuSet OtherCores(const CpuSet& taken) const
+        {
+            std::set<std::tuple<int, int, int>> takenCores;
+            for (const auto& cpu : cpus_) {
+                if (std::ranges::find(taken, cpu.id) != taken.end()) {
+                    takenCores.insert({ cpu.node, cpu.package, cpu.core });
+                }
+            }
+            CpuSet rest;
+            for (const auto& cpu : cpus_) {
+                if (!takenCores.contains({ cpu.node, cpu.package, cpu.core })) {
+                    rest.push_back(cpu.id);
+                }
+            }
+            return rest;
+        }
+    private:
+        static int ReadInt_(const std::filesystem::path& path, int fallback)
+        {
+            std::ifstream in{ path };
+            int value;
+            return in >> value ? value : fallback;
+        }
+        std::vector<Cpu> cpus_;
+    };
+
+    // restricts thread to cpus; false where affinity isn't supported or the call fails
+    inline bool PinThread(std::thread::native_handle_type thread, const CpuSet& cpus)
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const auto cpu : cpus) {
+            if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        return !cpus.empty() && pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+#else
+        (void)thread;
+        (void)cpus;
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,58 @@
+#include "AllocCounter.h"
+
+#ifdef MT_NEXT_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+// replaces global operator new/delete to count heap allocations made anywhere in the process
+// (array and nothrow forms route through these); the only definitions in the program, so the
+// compiler never sees free() meet a pointer from operator new in the same translation unit
+
+void* operator new(std::size_t size)
+{
+    HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    const auto alignment = static_cast<std::size_t>(align);
+#ifdef _MSC_VER
+    void* p = _aligned_malloc(size ? size : 1, alignment);
+#else
+    void* p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+    if (p) {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t align) noexcept
+{
+    operator delete(p, align);
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+
+// heap allocations made anywhere in the process, for the allocation columns of the benchmarks
+// counted by the replacement operator new/delete in AllocCounter.cpp, which only does anything
+// in builds with MT_NEXT_COUNT_ALLOCATIONS (the CMake option of the same name): it puts a shared
+// atomic increment on every allocation, so normal builds leave the global allocator alone and
+// the count stays 0
+
+#ifdef MT_NEXT_COUNT_ALLOCATIONS
+inline constexpr bool CountingAllocations = true;
+#else
+inline constexpr bool CountingAllocations = false;
+#endif
+
+inline std::atomic<size_t> HeapAllocations = 0;
+
+// benchmarks that report allocations say so up front when nothing is being counted
+inline void NoteAllocationCounting()
+{
+    if (!CountingAllocations) {
+        std::cout << "(heap allocations are only counted in builds with MT_NEXT_COUNT_ALLOCATIONS)" << std::endl;
+    }
+}
@@ -0,0 +1,300 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Constants.h"
+
+// sweeps a grid of mt-next command line knobs, running the mt-next binary once per sample
+// (pool sizes are fixed per process, so every point needs its own process) and reading back
+// the "Time taken" line it prints
+// results are written as CSV or JSON; two CSV result files can be diffed for regressions
+
+#ifdef _MSC_VER
+#define BENCH_POPEN _popen
+#define BENCH_PCLOSE _pclose
+#else
+#define BENCH_POPEN popen
+#define BENCH_PCLOSE pclose
+#endif
+
+namespace bench
+{
+    // one knob and the values it sweeps, parsed from "name=v1,v2,..."
+    struct Param
+    {
+        std::string name;
+        std::vector<std::string> values;
+    };
+    // knob values of one grid point, in the order the params were given
+    using Point = std::vector<std::pair<std::string, std::string>>;
+
+    struct Summary
+    {
+        size_t runs;
+        double mean;
+        // sample standard deviation (n - 1)
+        double stddev;
+        double min;
+        double max;
+        // 95% confidence interval of the mean (Student's t)
+        double ciLow;
+        double ciHigh;
+    };
+
+    struct Result
+    {
+        Point point;
+        Summary summary;
+    };
+
+    inline Param ParseParam(std::string_view spec)
+    {
+        const auto eq = spec.find('=');
+        if (eq == std::string_view::npos || eq == 0 || eq + 1 == spec.size()) {
+            throw std::invalid_argument{ "bad --param (expected name=v1,v2,...): " + std::string{ spec } };
+        }
+        Param param{ .name = std::string{ spec.substr(0, eq) }, .values = {} };
+        auto rest = spec.substr(eq + 1);
+        while (!rest.empty()) {
+            const auto comma = rest.find(',');
+            param.values.emplace_back(rest.substr(0, comma));
+            rest = comma == std::string_view::npos ? std::string_view{} : rest.substr(comma + 1);
+        }
+        return param;
+    }
+
+    // only value-taking mt-next options make sense as knobs; mt-next itself ignores
+    // options it doesn't know, so a misspelt knob would silently sweep nothing
+    inline void CheckKnob(const std::string& name)
+    {
+        popl::OptionParser op;
+        AddCliOptions(op);
+        for (const auto& option : op.options()) {
+            if (option->long_name() == name && option->argument_type() == popl::Argument::required) {
+                return;
+            }
+        }
+        throw std::invalid_argument{ "not an mt-next knob: " + name };
+    }
+
+    // cartesian product, last param varying fastest
+    inline std::vector<Point> ExpandGrid(const std::vector<Param>& params)
+    {
+        std::vector<Point> points{ Point{} };
+        for (const auto& param : params) {
+            std::vector<Point> next;
+            next.reserve(points.size() * param.values.size());
+            for (const auto& point : points) {
+                for (const auto& value : param.values) {
+                    next.push_back(point);
+                    next.back().emplace_back(param.name, value);
+                }
+            }
+            points = std::move(next);
+        }
+        return points;
+    }
+
+    // two-sided 95% critical value of Student's t for dof degrees of freedom
+    inline double StudentT95(size_t dof)
+    {
+        static constexpr double table[] = {
+            12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+            2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+            2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+        };
+        if (dof == 0) {
+            return 0.;
+        }
+        if (dof <= std::size(table)) {
+            return table[dof - 1];
+        }
+        // within 0.002 of the exact value from 30 degrees of freedom on
+        return 1.96 + 2.5 / double(dof);
+    }
+
+    inline Summary Summarize(const std::vector<double>& samples)
+    {
+        const auto n = samples.size();
+        Summary s{ .runs = n, .mean = 0., .stddev = 0., .min = 0., .max = 0., .ciLow = 0., .ciHigh = 0. };
+        if (n == 0) {
+            return s;
+        }
+        const auto [lo, hi] = std::ranges::minmax(samples);
+        s.min = lo;
+        s.max = hi;
+        for (const auto x : samples) {
+            s.mean += x;
+        }
+        s.mean /= double(n);
+        if (n > 1) {
+            double sq = 0.;
+            for (const auto x : samples) {
+                sq += (x - s.mean) * (x - s.mean);
+            }
+            s.stddev = std::sqrt(sq / double(n - 1));
+        }
+        const auto halfWidth = StudentT95(n - 1) * s.stddev / std::sqrt(double(n));
+        s.ciLow = s.mean - halfWidth;
+        s.ciHigh = s.mean + halfWidth;
+        return s;
+    }
+
+    inline std::string CommandLine(const std::string& exe, const std::string& extraArgs, const Point& point)
+    {
+        std::string cmd = "\"" + exe + "\"";
+        for (const auto& [name, value] : point) {
+            cmd += " --" + name + " " + value;
+        }
+        if (!extraArgs.empty()) {
+            cmd += " " + extraArgs;
+        }
+        return cmd;
+    }
+
+    // seconds reported by one run of mt-next, nothing if it failed or printed no time
+    inline std::optional<double> RunOnce(const std::string& command)
+    {
+        FILE* pipe = BENCH_POPEN(command.c_str(), "r");
+        if (!pipe) {
+            return std::nullopt;
+        }
+        std::string output;
+        char buffer[512];
+        while (const auto n = std::fread(buffer, 1, sizeof(buffer), pipe)) {
+            output.append(buffer, n);
+        }
+        if (BENCH_PCLOSE(pipe) != 0) {
+            return std::nullopt;
+        }
+        constexpr std::string_view marker = "Time taken: ";
+        const auto at = output.rfind(marker);
+        if (at == std::string::npos) {
+            return std::nullopt;
+        }
+        return std::strtod(output.c_str() + at + marker.size(), nullptr);
+    }
+
+    inline void WriteCsv(std::ostream& out, const std::vector<Result>& results)
+    {
+        if (results.empty()) {
+            return;
+        }
+        for (const auto& [name, value] : results.front().point) {
+            out << name << ',';
+        }
+        out << "runs,mean_s,stddev_s,min_s,max_s,ci95_low_s,ci95_high_s\n";
+        out << std::setprecision(9);
+        for (const auto& [point, s] : results) {
+            for (const auto& [name, value] : point) {
+                out << value << ',';
+            }
+            out << s.runs << ',' << s.mean << ',' << s.stddev << ',' << s.min << ',' << s.max << ','
+                << s.ciLow << ',' << s.ciHigh << '\n';
+        }
+    }
+
+    inline void WriteJson(std::ostream& out, const std::vector<Result>& results)
+    {
+        out << std::setprecision(9) << "[\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto& [point, s] = results[i];
+            out << "  { \"params\": { ";
+            for (size_t p = 0; p < point.size(); p++) {
+                out << (p ? ", " : "") << '"' << point[p].first << "\": \"" << point[p].second << '"';
+            }
+            out << " }, \"runs\": " << s.runs << ", \"mean_s\": " << s.mean << ", \"stddev_s\": " << s.stddev
+                << ", \"min_s\": " << s.min << ", \"max_s\": " << s.max
+                << ", \"ci95_low_s\": " << s.ciLow << ", \"ci95_high_s\": " << s.ciHigh << " }"
+                << (i + 1 < results.size() ? "," : "") << '\n';
+        }
+        out << "]\n";
+    }
+
+    // results written by WriteCsv, keyed by their comma-joined knob values
+    inline std::map<std::string, Summary> ReadCsv(const std::string& path)
+    {
+        std::ifstream in{ path };
+        if (!in) {
+            throw std::runtime_error{ "cannot open " + path };
+        }
+        const auto split = [](const std::string& line) {
+            std::vector<std::string> cells;
+            std::stringstream ss{ line };
+            for (std::string cell; std::getline(ss, cell, ',');) {
+                cells.push_back(cell);
+            }
+            return cells;
+        };
+        std::string line;
+        std::getline(in, line);
+        const auto header = split(line);
+        const auto nKnobs = size_t(std::ranges::find(header, "runs") - header.begin());
+        if (nKnobs == header.size() || header.size() != nKnobs + 7) {
+            throw std::runtime_error{ path + " is not a benchmark result file" };
+        }
+        std::map<std::string, Summary> rows;
+        while (std::getline(in, line)) {
+            const auto cells = split(line);
+            if (cells.size() != header.size()) {
+                continue;
+            }
+            std::string key;
+            for (size_t i = 0; i < nKnobs; i++) {
+                key += (i ? "," : "") + header[i] + "=" + cells[i];
+            }
+            const auto num = [&](size_t i) { return std::stod(cells[nKnobs + i]); };
+            rows[key] = { .runs = std::stoul(cells[nKnobs]), .mean = num(1), .stddev = num(2),
+                .min = num(3), .max = num(4), .ciLow = num(5), .ciHigh = num(6) };
+        }
+        return rows;
+    }
+
+    // a point regresses when its mean got slower by more than thresholdPct percent and the
+    // confidence intervals don't overlap (improvements are judged the same way)
+    // returns the number of regressions
+    inline size_t DiffResults(const std::string& baselinePath, const std::string& currentPath, double thresholdPct)
+    {
+        const auto baseline = ReadCsv(baselinePath);
+        const auto current = ReadCsv(currentPath);
+        size_t regressions = 0;
+        std::cout << std::fixed << std::setprecision(4);
+        for (const auto& [key, now] : current) {
+            const auto it = baseline.find(key);
+            if (it == baseline.end()) {
+                std::cout << "new        " << key << ": " << now.mean << "s\n";
+                continue;
+            }
+            const auto& was = it->second;
+            const auto changePct = was.mean > 0. ? (now.mean / was.mean - 1.) * 100. : 0.;
+            const char* verdict = "same       ";
+            if (changePct > thresholdPct && now.ciLow > was.ciHigh) {
+                verdict = "REGRESSION ";
+                regressions++;
+            }
+            else if (changePct < -thresholdPct && now.ciHigh < was.ciLow) {
+                verdict = "improved   ";
+            }
+            std::cout << verdict << key << ": " << was.mean << "s -> " << now.mean << "s ("
+                << std::showpos << changePct << std::noshowpos << "%)\n";
+        }
+        for (const auto& [key, was] : baseline) {
+            if (!current.contains(key)) {
+                std::cout << "missing    " << key << '\n';
+            }
+        }
+        std::cout << regressions << " regression(s)" << std::endl;
+        return regressions;
+    }
+}
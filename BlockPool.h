@@ -0,0 +1,200 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+namespace tk
+{
+    namespace detail
+    {
+        // fixed-size block recycler: each thread allocates from and frees into its own cache,
+        // and caches trade whole batches through a shared depot, so blocks allocated on one
+        // thread and freed on another (a future's shared state, say) come back without a
+        // trip to the heap; the depot lock is taken once per batch, not per block
+        class BlockPool
+        {
+        public:
+            static void* Allocate(size_t size)
+            {
+                const auto sizeClass = ClassOf_(size);
+                if (sizeClass >= nClasses_) {
+                    return ::operator new(size);
+                }
+                // a full block, so it can join the pool when it is freed
+                if (Cache_::destroyed_) {
+                    return ::operator new(BlockSize_(sizeClass));
+                }
+                return Cache_::Get().Pop(sizeClass);
+            }
+            static void Free(void* block, size_t size) noexcept
+            {
+                const auto sizeClass = ClassOf_(size);
+                if (sizeClass >= nClasses_) {
+                    ::operator delete(block);
+                    return;
+                }
+                // freed during thread exit after this thread's cache is gone: straight to the depot
+                if (Cache_::destroyed_) {
+                    Depot_::Get().Put(sizeClass, { ::new (block) Node_{ nullptr, nullptr, 0 }, 1 });
+                    return;
+                }
+                Cache_::Get().Push(sizeClass, block);
+            }
+
+        private:
+            // size classes of 64, 128, 256, 512 and 1024 bytes
+            static constexpr size_t minBlock_ = 64;
+            static constexpr size_t nClasses_ = 5;
+            static constexpr size_t batchSize_ = 64;
+            // types
+            struct Node_
+            {
+                Node_* next;
+                // only meaningful on the first node of a batch parked in the depot
+                Node_* nextBatch;
+                size_t count;
+            };
+            struct Batch_
+            {
+                Node_* head;
+                size_t count;
+            };
+            class Depot_
+            {
+            public:
+                // deliberately leaked: thread caches hand their blocks back at thread exit,
+                // which can be after static destruction has started
+                static Depot_& Get()
+                {
+                    static Depot_& depot = *new Depot_;
+                    return depot;
+                }
+                // batches are chained through their own first node, so the depot never allocates
+                void Put(size_t sizeClass, Batch_ batch)
+                {
+                    std::lock_guard lk{ mtx_ };
+                    batch.head->count = batch.count;
+                    batch.head->nextBatch = batches_[sizeClass];
+                    batches_[sizeClass] = batch.head;
+                }
+                Batch_ Take(size_t sizeClass)
+                {
+                    std::lock_guard lk{ mtx_ };
+                    auto* head = batches_[sizeClass];
+                    if (!head) {
+                        return { nullptr, 0 };
+                    }
+                    batches_[sizeClass] = head->nextBatch;
+                    return { head, head->count };
+                }
+            private:
+                std::mutex mtx_;
+                std::array<Node_*, nClasses_> batches_{};
+            };
+            class Cache_
+            {
+            public:
+                static Cache_& Get()
+                {
+                    thread_local Cache_ cache;
+                    return cache;
+                }
+                void* Pop(size_t sizeClass)
+                {
+                    if (!heads_[sizeClass]) {
+                        auto batch = Depot_::Get().Take(sizeClass);
+                        if (!batch.head) {
+                            batch = Carve_(sizeClass);
+                        }
+                        heads_[sizeClass] = batch.head;
+                        counts_[sizeClass] = batch.count;
+                    }
+                    auto* node = heads_[sizeClass];
+                    heads_[sizeClass] = node->next;
+                    counts_[sizeClass]--;
+                    return node;
+                }
+                void Push(size_t sizeClass, void* block) noexcept
+                {
+                    auto* node = ::new (block) Node_{ heads_[sizeClass], nullptr, 0 };
+                    heads_[sizeClass] = node;
+                    // keep up to two batches locally, hand the oldest one back beyond that
+                    if (++counts_[sizeClass] == 2 * batchSize_) {
+                        auto* tail = node;
+                        for (size_t i = 1; i < batchSize_; i++) {
+                            tail = tail->next;
+                        }
+                        Depot_::Get().Put(sizeClass, { tail->next, batchSize_ });
+                        tail->next = nullptr;
+                        counts_[sizeClass] = batchSize_;
+                    }
+                }
+                ~Cache_()
+                {
+                    for (size_t c = 0; c < nClasses_; c++) {
+                        if (heads_[c]) {
+                            Depot_::Get().Put(c, { heads_[c], counts_[c] });
+                        }
+                    }
+                    heads_ = {};
+                    counts_ = {};
+                    destroyed_ = true;
+                }
+                // set once this thread's cache has been destroyed; later thread-exit code (static
+                // destructors freeing pooled blocks, say) must not touch the dead cache
+                inline static thread_local bool destroyed_ = false;
+            private:
+                // grow by a whole batch at a time (one heap allocation, never returned) so a
+                // pool that has to grow reaches its working size quickly
+                static Batch_ Carve_(size_t sizeClass)
+                {
+                    const auto blockSize = BlockSize_(sizeClass);
+                    auto* slab = static_cast<std::byte*>(::operator new(blockSize * batchSize_));
+                    Node_* head = nullptr;
+                    for (size_t i = batchSize_; i-- > 0;) {
+                        head = ::new (slab + i * blockSize) Node_{ head, nullptr, 0 };
+                    }
+                    return { head, batchSize_ };
+                }
+                std::array<Node_*, nClasses_> heads_{};
+                std::array<size_t, nClasses_> counts_{};
+            };
+            // functions
+            static constexpr size_t ClassOf_(size_t size)
+            {
+                return size <= minBlock_ ? 0 : size_t(std::bit_width((size - 1) / minBlock_));
+            }
+            static constexpr size_t BlockSize_(size_t sizeClass)
+            {
+                return minBlock_ << sizeClass;
+            }
+        };
+    }
+
+    // std allocator front end for detail::BlockPool
+    template<typename T>
+    struct PoolAllocator
+    {
+        static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+        using value_type = T;
+
+        PoolAllocator() = default;
+        template<typename U>
+        PoolAllocator(const PoolAllocator<U>&) noexcept {}
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(detail::BlockPool::Allocate(n * sizeof(T)));
+        }
+        void deallocate(T* p, size_t n) noexcept
+        {
+            detail::BlockPool::Free(p, n * sizeof(T));
+        }
+        template<typename U>
+        bool operator==(const PoolAllocator<U>&) const noexcept
+        {
+            return true;
+        }
+    };
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+namespace tk
+{
+    // marks the calling thread as blocked (sleeping, waiting on a future, ...) for the
+    // region's lifetime; on a pool worker this is counted by the pool, so an elastic pool can
+    // start extra workers to keep its runnable worker count up. anywhere else it does nothing
+    class BlockingRegion
+    {
+    public:
+        BlockingRegion() : counter_{ threadCounter_ }
+        {
+            if (counter_) {
+                counter_->fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        BlockingRegion(const BlockingRegion&) = delete;
+        BlockingRegion& operator=(const BlockingRegion&) = delete;
+        ~BlockingRegion()
+        {
+            if (counter_) {
+                counter_->fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        // installed by pool workers for their own thread
+        static void SetThreadCounter(std::atomic<size_t>* counter)
+        {
+            threadCounter_ = counter;
+        }
+    private:
+        std::atomic<size_t>* counter_;
+        inline static thread_local std::atomic<size_t>* threadCounter_ = nullptr;
+    };
+}
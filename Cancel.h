@@ -0,0 +1,53 @@
+#pragma once
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include <utility>
+
+namespace tk
+{
+    // the error a future (or task group) gets when its task was dropped before running
+    class Cancelled : public std::runtime_error
+    {
+    public:
+        Cancelled() : std::runtime_error{ "task cancelled before it ran" } {}
+    protected:
+        explicit Cancelled(const char* what) : std::runtime_error{ what } {}
+    };
+    // dropped at dequeue because its deadline had passed
+    class DeadlineExceeded : public Cancelled
+    {
+    public:
+        DeadlineExceeded() : Cancelled{ "task deadline passed before it ran" } {}
+    };
+
+    namespace detail
+    {
+        // the error a promise (or group member) reports when it is destroyed unfulfilled:
+        // broken_promise, or whatever the innermost AbandonScope on this thread says
+        inline thread_local std::exception_ptr abandonReason_;
+
+        inline std::exception_ptr AbandonError()
+        {
+            if (abandonReason_) {
+                return abandonReason_;
+            }
+            return std::make_exception_ptr(std::future_error{ std::future_errc::broken_promise });
+        }
+
+        // tasks destroyed within the scope (by a queue being drained) fail with reason
+        class AbandonScope
+        {
+        public:
+            explicit AbandonScope(std::exception_ptr reason) : previous_{ std::exchange(abandonReason_, std::move(reason)) } {}
+            AbandonScope(const AbandonScope&) = delete;
+            AbandonScope& operator=(const AbandonScope&) = delete;
+            ~AbandonScope()
+            {
+                abandonReason_ = std::move(previous_);
+            }
+        private:
+            std::exception_ptr previous_;
+        };
+    }
+}
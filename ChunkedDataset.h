@@ -0,0 +1,127 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include "Constants.h"
+#include "Parallel.h"
+#include "Task.h"
+
+// counter-based dataset generation: task i is a pure function of (spec, i) instead of the i-th
+// draw from one sequential engine, so any chunk can be generated on its own, on any thread and
+// in any order, and the dataset comes out identical however it is split up
+// the values differ from the minstd_rand streams of GenerateDataset but follow the same
+// distributions: random has independent heavy flags, even has one heavy task every
+// 1 / probabilityHeavy tasks, and stacked has the even dataset's heavy count, all up front
+struct DatasetSpec
+{
+    enum class Kind
+    {
+        Random,
+        Even,
+        Stacked,
+    };
+    Kind kind;
+    size_t size;
+    double probabilityHeavy;
+    uint64_t seed = 0;
+
+    // the dataset the command line asks for
+    static DatasetSpec FromCli(std::string_view kind)
+    {
+        if (kind == "random") {
+            return { Kind::Random, DatasetSize, ProbabilityHeavy };
+        }
+        if (kind == "even") {
+            return { Kind::Even, DatasetSize, ProbabilityHeavy };
+        }
+        if (kind == "stacked") {
+            return { Kind::Stacked, DatasetSize, ProbabilityHeavy };
+        }
+        throw std::invalid_argument{ "unknown dataset (expected random, even or stacked)" };
+    }
+};
+
+// output n of a SplitMix64 generator seeded with seed, computed directly from n
+inline uint64_t SplitMix64At(uint64_t seed, uint64_t n)
+{
+    auto z = seed + (n + 1) * 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// uniform in [0, 1) from the top 53 bits
+inline double UnitInterval(uint64_t bits)
+{
+    return double(bits >> 11) * 0x1p-53;
+}
+
+// heavy tasks among the first n of the even pattern
+inline size_t EvenHeavyCount(const DatasetSpec& spec, size_t n)
+{
+    return size_t(std::floor(double(n) * spec.probabilityHeavy));
+}
+
+inline Task GenerateTask(const DatasetSpec& spec, size_t i)
+{
+    const auto val = UnitInterval(SplitMix64At(spec.seed, 2 * i)) * 2. * std::numbers::pi;
+    bool heavy = false;
+    switch (spec.kind) {
+    case DatasetSpec::Kind::Random:
+        heavy = UnitInterval(SplitMix64At(spec.seed, 2 * i + 1)) < spec.probabilityHeavy;
+        break;
+    case DatasetSpec::Kind::Even:
+        heavy = EvenHeavyCount(spec, i + 1) > EvenHeavyCount(spec, i);
+        break;
+    case DatasetSpec::Kind::Stacked:
+        heavy = i < EvenHeavyCount(spec, spec.size);
+        break;
+    }
+    return { .val = val, .heavy = heavy };
+}
+
+// tasks [first, first + out.size()) of the dataset
+inline void GenerateDatasetChunk(const DatasetSpec& spec, size_t first, std::span<Task> out)
+{
+    for (size_t i = 0; i < out.size(); i++) {
+        out[i] = GenerateTask(spec, first + i);
+    }
+}
+
+// the whole dataset, one chunk per ParallelFor element on pool
+inline Dataset GenerateDatasetParallel(tk::ThreadPool& pool, const DatasetSpec& spec, size_t chunkSize = 1 << 16)
+{
+    Dataset data(spec.size);
+    const auto nChunks = (spec.size + chunkSize - 1) / chunkSize;
+    tk::ParallelFor(pool, std::views::iota(size_t(0), nChunks), [&](size_t c) {
+        const auto first = c * chunkSize;
+        GenerateDatasetChunk(spec, first, std::span{ data }.subspan(first, std::min(chunkSize, spec.size - first)));
+    });
+    return data;
+}
+
+// the dataset in order, one chunk at a time, generated only when asked for
+class DatasetStream
+{
+public:
+    explicit DatasetStream(DatasetSpec spec, size_t chunkSize = 1 << 12)
+        : spec_{ spec }, chunkSize_{ std::max<size_t>(chunkSize, 1) } {}
+    // the next chunk, empty once the dataset is exhausted
+    Dataset Next()
+    {
+        Dataset chunk(std::min(chunkSize_, spec_.size - next_));
+        GenerateDatasetChunk(spec_, next_, chunk);
+        next_ += chunk.size();
+        return chunk;
+    }
+private:
+    DatasetSpec spec_;
+    size_t chunkSize_;
+    size_t next_ = 0;
+};
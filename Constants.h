@@ -1,25 +1,86 @@
 #pragma once
 #include "popl.h"
+#include <cstdint>
 #include <iostream>
+#include <string>
 
 inline size_t AsyncCount = 32;
 inline size_t ComputeCount = 4;
+inline size_t AsyncMax = 0;
+inline size_t ComputeMax = 0;
+inline uint32_t IdleSpins = 0;
+inline uint32_t IdleYields = 0;
 inline size_t DatasetSize = 2'000;
 inline size_t LightIterations = 1'000;
 inline size_t HeavyIterations = 10'000;
 inline double ProbabilityHeavy = .15;
 inline int AsyncSleep = 20;
+inline int Budget = 0;
+inline std::string DatasetKind = "random";
+inline std::string QueueModeName = "shared";
+inline std::string Pipeline = "then";
+inline std::string Generator = "serial";
+inline std::string ProcessEngine = "scalar";
+inline std::string TableCachePath;
+inline std::string TracePath;
+inline std::string SaveDatasetPath;
+inline std::string LoadDatasetPath;
+inline std::string ComputeAffinity = "none";
+inline std::string AsyncAffinity = "none";
+inline bool BenchQueue = false;
+inline bool BenchSubmit = false;
+inline bool BenchSchedule = false;
+inline bool BenchWake = false;
+inline bool BenchCancel = false;
+inline bool BenchIterations = false;
+inline bool BenchFuture = false;
+inline bool BenchGraph = false;
+inline bool VerifyBatch = false;
+inline bool VerifyDataset = false;
+inline bool VerifyTable = false;
 
-void ParseCli(int argc, const char** argv)
+void AddCliOptions(popl::OptionParser& op)
 {
 	using namespace popl;
-	OptionParser op;
 	op.add<Value<size_t>>("", "async-count", "")->assign_to(&AsyncCount);
 	op.add<Value<size_t>>("", "compute-count", "")->assign_to(&ComputeCount);
+	op.add<Value<size_t>>("", "async-max", "grow the async pool up to this many workers while its workers are blocked (elastic pool)")->assign_to(&AsyncMax);
+	op.add<Value<size_t>>("", "compute-max", "grow the compute pool up to this many workers while its workers are blocked (elastic pool)")->assign_to(&ComputeMax);
+	op.add<Value<uint32_t>>("", "idle-spins", "idle workers check for work this many times (with a cpu pause) before yielding")->assign_to(&IdleSpins);
+	op.add<Value<uint32_t>>("", "idle-yields", "then this many times (with a thread yield) before parking")->assign_to(&IdleYields);
 	op.add<Value<size_t>>("", "dataset-size", "")->assign_to(&DatasetSize);
 	op.add<Value<size_t>>("", "light-iterations", "")->assign_to(&LightIterations);
 	op.add<Value<size_t>>("", "heavy-iterations", "")->assign_to(&HeavyIterations);
 	op.add<Value<double>>("", "probability-heavy", "")->assign_to(&ProbabilityHeavy);
 	op.add<Value<int>>("", "async-sleep", "")->assign_to(&AsyncSleep);
+	op.add<Value<int>>("", "budget", "milliseconds the then, blocking and coro pipelines may take; then queued work is cancelled and chains still in flight skip their compute step (0: no budget)")->assign_to(&Budget);
+	op.add<Value<std::string>>("", "dataset", "random, even or stacked")->assign_to(&DatasetKind);
+	op.add<Value<std::string>>("", "generator", "serial (one minstd_rand stream), parallel (counter-based chunks generated on the compute pool before timing) or stream (the same chunks generated on demand while the then, blocking or coro pipeline runs; parallel for the others)")->assign_to(&Generator);
+	op.add<Value<std::string>>("", "save-dataset", "write the dataset chosen by --dataset, --dataset-size, --probability-heavy and --generator to a file and exit")->assign_to(&SaveDatasetPath);
+	op.add<Value<std::string>>("", "load-dataset", "process the tasks of a dataset file in place (memory-mapped) instead of generating them")->assign_to(&LoadDatasetPath);
+	op.add<Switch>("", "verify-dataset", "check the loaded dataset file's checksum (a full read) before running")->assign_to(&VerifyDataset);
+	op.add<Value<std::string>>("", "engine", "how compute steps run Task::Process: scalar (sin/cos every iteration), table (one lookup per iteration after the first) or jump (first iteration plus one jump on the decomposed table, whatever the iteration count); the batch pipeline always uses ProcessBatch")->assign_to(&ProcessEngine);
+	op.add<Value<std::string>>("", "table-cache", "cache the transition table in this file, loading it from there when present (default: rebuild it every run)")->assign_to(&TableCachePath);
+	op.add<Value<std::string>>("", "queue-mode", "shared, stealing, lockfree or lpt (longest task first)")->assign_to(&QueueModeName);
+	op.add<Value<std::string>>("", "pipeline", "then (timer delay chained with Then), blocking (a sleeping async group member that spawns its compute step into the same TaskGroup), coro (one coroutine per item), graph (fetch on the async pool, then compute, as one tk::Graph run per item), bulk (compute only, one RunBulk batch), parallel (compute only, ParallelTransform) or batch (compute only, ParallelFor over ProcessBatch chunks)")->assign_to(&Pipeline);
+	op.add<Value<std::string>>("", "compute-affinity", "none, cores (one compute worker per physical core) or a cpu list like 0-3,8")->assign_to(&ComputeAffinity);
+	op.add<Value<std::string>>("", "async-affinity", "none, rest (cores left over by the compute workers) or a cpu list; also applies to the timer thread")->assign_to(&AsyncAffinity);
+	op.add<Value<std::string>>("", "trace", "write a Chrome trace-event JSON timeline of pool activity (open in Perfetto)")->assign_to(&TracePath);
+	op.add<Switch>("", "bench-queue", "")->assign_to(&BenchQueue);
+	op.add<Switch>("", "bench-submit", "")->assign_to(&BenchSubmit);
+	op.add<Switch>("", "bench-schedule", "FIFO vs longest-task-first makespan on every dataset")->assign_to(&BenchSchedule);
+	op.add<Switch>("", "bench-wake", "submit-to-start latency of idle pools for each queue mode and idle policy")->assign_to(&BenchWake);
+	op.add<Switch>("", "bench-cancel", "how quickly CancelPending takes effect on fully loaded pools in every queue mode")->assign_to(&BenchCancel);
+	op.add<Switch>("", "verify-table", "time the transition table engine and compare it bit-exactly against Task::Process")->assign_to(&VerifyTable);
+	op.add<Switch>("", "bench-future", "fan-out and fan-in of a million tasks through tk::Future against std::future")->assign_to(&BenchFuture);
+	op.add<Switch>("", "bench-graph", "scheduling overhead per node of tk::Graph runs against plain posted tasks")->assign_to(&BenchGraph);
+	op.add<Switch>("", "bench-iterations", "per-task cost of the scalar, table and jump engines from 1e3 to 1e9 iterations")->assign_to(&BenchIterations);
+	op.add<Switch>("", "verify-batch", "time ProcessBatch kernels and compare them bit-exactly against Task::Process")->assign_to(&VerifyBatch);
+}
+
+void ParseCli(int argc, const char** argv)
+{
+	popl::OptionParser op;
+	AddCliOptions(op);
 	op.parse(argc, argv);
 }
\ No newline at end of file
@@ -0,0 +1,259 @@
+#pragma once
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include "Cancel.h"
+#include "Future.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+namespace tk
+{
+    namespace detail
+    {
+        template<typename T>
+        class TaskPromiseBase
+        {
+        public:
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            auto final_suspend() noexcept
+            {
+                // symmetric transfer back to whoever awaited us, so deep chains don't grow the stack
+                struct Awaiter
+                {
+                    bool await_ready() noexcept { return false; }
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept
+                    {
+                        return continuation ? continuation : std::noop_coroutine();
+                    }
+                    void await_resume() noexcept {}
+                    std::coroutine_handle<> continuation;
+                };
+                return Awaiter{ continuation_ };
+            }
+            void unhandled_exception()
+            {
+                exception_ = std::current_exception();
+            }
+            void SetContinuation(std::coroutine_handle<> continuation)
+            {
+                continuation_ = continuation;
+            }
+        protected:
+            std::coroutine_handle<> continuation_;
+            std::exception_ptr exception_;
+        };
+
+        template<typename T>
+        class TaskPromise : public TaskPromiseBase<T>
+        {
+        public:
+            auto get_return_object();
+            template<typename V>
+            void return_value(V&& value)
+            {
+                value_.emplace(std::forward<V>(value));
+            }
+            T Take()
+            {
+                if (this->exception_) {
+                    std::rethrow_exception(this->exception_);
+                }
+                return std::move(*value_);
+            }
+        private:
+            std::optional<T> value_;
+        };
+
+        template<>
+        class TaskPromise<void> : public TaskPromiseBase<void>
+        {
+        public:
+            auto get_return_object();
+            void return_void() {}
+            void Take()
+            {
+                if (exception_) {
+                    std::rethrow_exception(exception_);
+                }
+            }
+        };
+
+        // posted to resume a suspended coroutine; if the pool drops it unrun (CancelPending),
+        // the coroutine is resumed right away with the abandon error instead, which its
+        // awaiter rethrows so the coroutine unwinds rather than staying suspended forever
+        class Resumption
+        {
+        public:
+            Resumption(std::coroutine_handle<> handle, std::exception_ptr& error) : handle_{ handle }, error_{ &error } {}
+            Resumption(Resumption&& other) noexcept : handle_{ std::exchange(other.handle_, nullptr) }, error_{ other.error_ } {}
+            Resumption& operator=(Resumption&&) = delete;
+            ~Resumption()
+            {
+                if (handle_) {
+                    *error_ = AbandonError();
+                    handle_.resume();
+                }
+            }
+            void operator()()
+            {
+                std::exchange(handle_, nullptr).resume();
+            }
+        private:
+            std::coroutine_handle<> handle_;
+            std::exception_ptr* error_;
+        };
+
+        // eagerly started, self-destroying frame used to bridge a Task into a Future
+        struct Detached
+        {
+            struct promise_type
+            {
+                Detached get_return_object() { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { std::terminate(); }
+            };
+        };
+    }
+
+    // lazily started coroutine; co_await it from another coroutine or hand it to Spawn
+    template<typename T = void>
+    class Task
+    {
+    public:
+        using promise_type = detail::TaskPromise<T>;
+
+        explicit Task(std::coroutine_handle<promise_type> handle) : handle_{ handle } {}
+        Task(Task&& other) noexcept : handle_{ std::exchange(other.handle_, nullptr) } {}
+        Task& operator=(Task&& other) noexcept
+        {
+            if (this != &other) {
+                if (handle_) {
+                    handle_.destroy();
+                }
+                handle_ = std::exchange(other.handle_, nullptr);
+            }
+            return *this;
+        }
+        ~Task()
+        {
+            if (handle_) {
+                handle_.destroy();
+            }
+        }
+        auto operator co_await() && noexcept
+        {
+            struct Awaiter
+            {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+                {
+                    handle.promise().SetContinuation(awaiting);
+                    return handle;
+                }
+                T await_resume()
+                {
+                    return handle.promise().Take();
+                }
+                std::coroutine_handle<promise_type> handle;
+            };
+            return Awaiter{ handle_ };
+        }
+    private:
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    template<typename T>
+    auto detail::TaskPromise<T>::get_return_object()
+    {
+        return Task<T>{ std::coroutine_handle<TaskPromise>::from_promise(*this) };
+    }
+    inline auto detail::TaskPromise<void>::get_return_object()
+    {
+        return Task<void>{ std::coroutine_handle<TaskPromise>::from_promise(*this) };
+    }
+
+    // start a task on the calling thread and observe its completion through a Future
+    template<typename T>
+    Future<T> Spawn(Task<T> task)
+    {
+        Promise<T> promise;
+        auto future = promise.GetFuture();
+        [](Task<T> task, Promise<T> promise) -> detail::Detached {
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await std::move(task);
+                    promise.SetValue();
+                }
+                else {
+                    promise.SetValue(co_await std::move(task));
+                }
+            }
+            catch (...) {
+                promise.SetException(std::current_exception());
+            }
+        }(std::move(task), std::move(promise));
+        return future;
+    }
+
+    // resume the awaiting coroutine on a worker of pool (queued with hint); throws Cancelled
+    // if the pool cancels the resumption instead
+    inline auto ScheduleOn(ThreadPool& pool, CostHint hint = {})
+    {
+        struct Awaiter
+        {
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                pool.Post(detail::Resumption{ h, error }, hint);
+            }
+            void await_resume()
+            {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+            ThreadPool& pool;
+            CostHint hint;
+            std::exception_ptr error = nullptr;
+        };
+        return Awaiter{ pool, hint };
+    }
+
+    // suspend without holding a thread; resumes on the pool the coroutine was running on
+    // (or on the timer thread when awaited from outside any pool)
+    template<typename R, typename P>
+    auto SleepFor(std::chrono::duration<R, P> delay)
+    {
+        struct Awaiter
+        {
+            bool await_ready() noexcept { return delay <= Timer::Clock::duration::zero(); }
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                Timer::Default().After(delay, [h, error = &error, pool = ThreadPool::Current()] {
+                    if (pool) {
+                        pool->Post(detail::Resumption{ h, *error });
+                    }
+                    else {
+                        h.resume();
+                    }
+                });
+            }
+            void await_resume()
+            {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+            Timer::Clock::duration delay;
+            std::exception_ptr error = nullptr;
+        };
+        return Awaiter{ std::chrono::duration_cast<Timer::Clock::duration>(delay) };
+    }
+}
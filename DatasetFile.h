@@ -0,0 +1,310 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ChunkedDataset.h"
+#include "Task.h"
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// binary dataset file: a 64-byte header followed by count records laid out exactly like Task in
+// memory (little-endian double value, one heavy byte that is 0 or 1, seven zero bytes), so a
+// mapped file is used as a span<const Task> in place and pages in as the pipeline reaches it
+// the header records how the tasks were generated and a checksum of the records; opening only
+// reads the header, checking the whole file is a separate full pass (MappedDataset::Verify)
+// a heavy byte other than 0 or 1 is not a valid bool, so records are handed out a range at a
+// time (MappedDataset::Tasks) and each range's heavy bytes are checked just then; reading the
+// file slice by slice keeps that check on pages the pipeline is about to touch anyway
+
+static_assert(std::endian::native == std::endian::little, "dataset files are little-endian");
+static_assert(sizeof(Task) == 16 && offsetof(Task, val) == 0 && offsetof(Task, heavy) == 8 && sizeof(bool) == 1,
+    "dataset file records must match the Task layout");
+
+struct DatasetFileHeader
+{
+    // how the tasks were made; replayed or hand-made data can say External
+    enum class Generator : uint32_t
+    {
+        Serial,
+        Counter,
+        External,
+    };
+    static constexpr uint32_t currentVersion = 1;
+    // the only layout so far: Task records
+    static constexpr uint32_t taskLayout = 1;
+
+    char magic[8] = { 'm', 't', 'n', 'e', 'x', 't', 'd', 's' };
+    uint32_t version = currentVersion;
+    uint32_t layout = taskLayout;
+    uint64_t count = 0;
+    Generator generator = Generator::External;
+    DatasetSpec::Kind kind = DatasetSpec::Kind::Random;
+    double probabilityHeavy = 0.;
+    uint64_t seed = 0;
+    uint64_t checksum = 0;
+    uint64_t reserved = 0;
+
+    bool HasMagic() const
+    {
+        return std::memcmp(magic, DatasetFileHeader{}.magic, sizeof(magic)) == 0;
+    }
+};
+static_assert(sizeof(DatasetFileHeader) == 64 && sizeof(DatasetSpec::Kind) == 4);
+
+// order-dependent hash of the records, one 64-bit word at a time; extend it chunk by chunk
+inline uint64_t DatasetChecksum(uint64_t hash, std::span<const Task> tasks)
+{
+    for (const auto& t : tasks) {
+        uint64_t words[2];
+        std::memcpy(words, &t, sizeof(words));
+        for (const auto w : words) {
+            hash = std::rotl((hash ^ w) * 0x9e3779b97f4a7c15ull, 31);
+        }
+    }
+    return hash;
+}
+
+// writes a dataset file chunk by chunk; the header is finalized by Close
+class DatasetWriter
+{
+public:
+    DatasetWriter(const std::string& path, DatasetFileHeader header)
+        : file_{ std::fopen(path.c_str(), "wb") }, header_{ header }
+    {
+        if (!file_) {
+            throw std::runtime_error{ "cannot create " + path };
+        }
+        header_.count = 0;
+        header_.checksum = 0;
+        Write_(&header_, sizeof(header_));
+    }
+    DatasetWriter(const DatasetWriter&) = delete;
+    DatasetWriter& operator=(const DatasetWriter&) = delete;
+    ~DatasetWriter()
+    {
+        if (file_) {
+            std::fclose(file_);
+        }
+    }
+    void Append(std::span<const Task> tasks)
+    {
+        // copied field by field so padding is written as zeros and flags as 0 or 1
+        records_.resize(tasks.size());
+        std::memset(records_.data(), 0, records_.size() * sizeof(Task));
+        for (size_t i = 0; i < tasks.size(); i++) {
+            records_[i].val = tasks[i].val;
+            records_[i].heavy = tasks[i].heavy;
+        }
+        header_.checksum = DatasetChecksum(header_.checksum, records_);
+        header_.count += tasks.size();
+        Write_(records_.data(), records_.size() * sizeof(Task));
+    }
+    void Close()
+    {
+        if (std::fseek(file_, 0, SEEK_SET) != 0) {
+            throw std::runtime_error{ "cannot rewrite dataset header" };
+        }
+        Write_(&header_, sizeof(header_));
+        const auto failed = std::fclose(std::exchange(file_, nullptr)) != 0;
+        if (failed) {
+            throw std::runtime_error{ "cannot finish dataset file" };
+        }
+    }
+    const DatasetFileHeader& Header() const
+    {
+        return header_;
+    }
+private:
+    void Write_(const void* data, size_t size)
+    {
+        if (size > 0 && std::fwrite(data, 1, size, file_) != size) {
+            throw std::runtime_error{ "cannot write dataset file" };
+        }
+    }
+    std::FILE* file_;
+    DatasetFileHeader header_;
+    std::vector<Task> records_;
+};
+
+// read-only mapping of a dataset file; constant time to open whatever its size
+class MappedDataset
+{
+public:
+    explicit MappedDataset(const std::string& path)
+    {
+        size_t size = 0;
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER fileSize;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &fileSize)) {
+            Unmap_();
+            throw std::runtime_error{ "cannot open " + path };
+        }
+        size = size_t(fileSize.QuadPart);
+        mapping_ = size ? CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+        data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            throw std::runtime_error{ "cannot open " + path };
+        }
+        size = size_t(st.st_size);
+        if (size > 0) {
+            data_ = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data_ == MAP_FAILED) {
+                data_ = nullptr;
+            }
+        }
+        ::close(fd);
+#endif
+        size_ = size;
+        if (!data_) {
+            Unmap_();
+            throw std::runtime_error{ "cannot map " + path };
+        }
+        const auto& header = Header();
+        const auto fail = [&](const std::string& why) {
+            Unmap_();
+            throw std::runtime_error{ path + ": " + why };
+        };
+        if (size_ < sizeof(DatasetFileHeader) || !header.HasMagic()) {
+            fail("not a dataset file");
+        }
+        if (header.version != DatasetFileHeader::currentVersion || header.layout != DatasetFileHeader::taskLayout) {
+            fail("unsupported dataset version " + std::to_string(header.version) + " / layout " + std::to_string(header.layout));
+        }
+        if ((size_ - sizeof(DatasetFileHeader)) / sizeof(Task) < header.count) {
+            fail("truncated, header promises " + std::to_string(header.count) + " tasks");
+        }
+#ifndef _WIN32
+        ::madvise(data_, size_, MADV_SEQUENTIAL);
+#endif
+    }
+    MappedDataset(MappedDataset&& other) noexcept
+        : data_{ std::exchange(other.data_, nullptr) }, size_{ std::exchange(other.size_, 0) }
+#ifdef _WIN32
+        , file_{ std::exchange(other.file_, INVALID_HANDLE_VALUE) }, mapping_{ std::exchange(other.mapping_, nullptr) }
+#endif
+    {}
+    MappedDataset& operator=(MappedDataset&& other) noexcept
+    {
+        if (this != &other) {
+            Unmap_();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+#ifdef _WIN32
+            file_ = std::exchange(other.file_, INVALID_HANDLE_VALUE);
+            mapping_ = std::exchange(other.mapping_, nullptr);
+#endif
+        }
+        return *this;
+    }
+    ~MappedDataset()
+    {
+        Unmap_();
+    }
+    const DatasetFileHeader& Header() const
+    {
+        return *static_cast<const DatasetFileHeader*>(data_);
+    }
+    // records [first, first + count), throwing if any of them has a corrupt heavy byte
+    std::span<const Task> Tasks(size_t first, size_t count) const
+    {
+        if (first > Header().count || count > Header().count - first) {
+            throw std::out_of_range{ "dataset records out of range" };
+        }
+        if (const auto bad = FirstBadFlag_(first, count); bad < first + count) {
+            throw std::runtime_error{ "dataset record " + std::to_string(bad) + " has a corrupt heavy flag" };
+        }
+        return Records_().subspan(first, count);
+    }
+    size_t Size() const
+    {
+        return size_t(Header().count);
+    }
+    // reads every record: the checksum must match and every heavy byte must be 0 or 1
+    bool Verify() const
+    {
+        const auto count = size_t(Header().count);
+        return FirstBadFlag_(0, count) == count && DatasetChecksum(0, Records_()) == Header().checksum;
+    }
+private:
+    // the records as Tasks, unchecked; only their bytes may be read until the flags are checked
+    std::span<const Task> Records_() const
+    {
+        const auto* first = reinterpret_cast<const Task*>(static_cast<const std::byte*>(data_) + sizeof(DatasetFileHeader));
+        return { first, size_t(Header().count) };
+    }
+    // index of the first record in [first, first + count) whose heavy byte is not 0 or 1, else first + count
+    size_t FirstBadFlag_(size_t first, size_t count) const
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data_) + sizeof(DatasetFileHeader);
+        for (size_t i = first; i < first + count; i++) {
+            if (bytes[i * sizeof(Task) + offsetof(Task, heavy)] > 1) {
+                return i;
+            }
+        }
+        return first + count;
+    }
+    void Unmap_() noexcept
+    {
+#ifdef _WIN32
+        if (data_) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_) {
+            CloseHandle(mapping_);
+        }
+        if (file_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(file_);
+        }
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) {
+            ::munmap(data_, size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+    void* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+// header for a dataset generated from the command line options
+inline DatasetFileHeader DescribeDataset(DatasetFileHeader::Generator generator, std::string_view kind)
+{
+    const auto spec = DatasetSpec::FromCli(kind);
+    DatasetFileHeader header;
+    header.generator = generator;
+    header.kind = spec.kind;
+    header.probabilityHeavy = spec.probabilityHeavy;
+    header.seed = spec.seed;
+    return header;
+}
@@ -0,0 +1,245 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include "BlockPool.h"
+#include "Blocking.h"
+#include "Cancel.h"
+#include "InlineTask.h"
+
+namespace tk
+{
+    template<typename T>
+    class Future;
+    class TaskGroup;
+
+    namespace detail
+    {
+        // one atomic word holds the whole protocol: the completer publishes the result with a
+        // single exchange to ready and learns from the old word whether a continuation was
+        // attached or anyone is blocked; waiters block with atomic wait, so neither side ever
+        // takes a lock and an uncontended Get never enters the kernel
+        template<typename T>
+        class SharedState
+        {
+            using Storage_ = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+            enum : uint32_t
+            {
+                ready_ = 1,
+                continuation_ = 2,
+                waiting_ = 4,
+            };
+        public:
+            template<typename...V>
+            void SetValue(V&&...value)
+            {
+                value_.emplace(std::forward<V>(value)...);
+                Complete_();
+            }
+            void SetException(std::exception_ptr exception)
+            {
+                exception_ = std::move(exception);
+                Complete_();
+            }
+            // the continuation runs exactly once, on whichever thread completes the state
+            // (or right here if it is already complete), so it should only hand work off
+            // at most one continuation per state
+            void OnReady(InlineTask continuation)
+            {
+                onReady_ = std::move(continuation);
+                if (state_.fetch_or(continuation_, std::memory_order_acq_rel) & ready_) {
+                    std::exchange(onReady_, {})();
+                }
+            }
+            void Wait()
+            {
+                auto s = state_.load(std::memory_order_acquire);
+                if (s & ready_) {
+                    return;
+                }
+                BlockingRegion blocking;
+                while (!(s & ready_)) {
+                    if (!(s & waiting_)) {
+                        s = state_.fetch_or(waiting_, std::memory_order_acquire) | waiting_;
+                        continue;
+                    }
+                    state_.wait(s, std::memory_order_acquire);
+                    s = state_.load(std::memory_order_acquire);
+                }
+            }
+            bool IsReady() const
+            {
+                return state_.load(std::memory_order_acquire) & ready_;
+            }
+            // only valid once ready
+            const std::exception_ptr& GetException() const
+            {
+                return exception_;
+            }
+            T Take()
+            {
+                if (exception_) {
+                    std::rethrow_exception(exception_);
+                }
+                if constexpr (!std::is_void_v<T>) {
+                    return std::move(*value_);
+                }
+            }
+        private:
+            // the caller keeps the state alive until this returns (Promise hands over its reference)
+            void Complete_()
+            {
+                const auto previous = state_.exchange(ready_, std::memory_order_acq_rel);
+                if (previous & waiting_) {
+                    state_.notify_all();
+                }
+                if (previous & continuation_) {
+                    std::exchange(onReady_, {})();
+                }
+            }
+            std::atomic<uint32_t> state_ = 0;
+            std::optional<Storage_> value_;
+            std::exception_ptr exception_;
+            InlineTask onReady_;
+        };
+
+        template<typename T, typename F>
+        struct ContinuationResult
+        {
+            using type = std::invoke_result_t<F, T>;
+        };
+        template<typename F>
+        struct ContinuationResult<void, F>
+        {
+            using type = std::invoke_result_t<F>;
+        };
+    }
+
+    template<typename T>
+    class Promise
+    {
+    public:
+        // shared state is recycled through per-thread block caches rather than the heap
+        Promise() : state_{ std::allocate_shared<detail::SharedState<T>>(PoolAllocator<detail::SharedState<T>>{}) } {}
+        Promise(Promise&&) = default;
+        Promise& operator=(Promise&&) = default;
+        ~Promise()
+        {
+            // same contract as std::promise: a dropped promise wakes its waiters with an error
+            // (Cancelled rather than broken_promise when a pool drops it on purpose)
+            if (state_) {
+                state_->SetException(detail::AbandonError());
+            }
+        }
+        Future<T> GetFuture()
+        {
+            return Future<T>{ state_ };
+        }
+        template<typename...V>
+        void SetValue(V&&...value)
+        {
+            std::exchange(state_, nullptr)->SetValue(std::forward<V>(value)...);
+        }
+        void SetException(std::exception_ptr exception)
+        {
+            std::exchange(state_, nullptr)->SetException(std::move(exception));
+        }
+        // invoke f and store its result, or whatever it throws
+        template<typename F>
+        void Fulfill(F&& f)
+        {
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    std::invoke(std::forward<F>(f));
+                    SetValue();
+                }
+                else {
+                    SetValue(std::invoke(std::forward<F>(f)));
+                }
+            }
+            catch (...) {
+                SetException(std::current_exception());
+            }
+        }
+    private:
+        std::shared_ptr<detail::SharedState<T>> state_;
+    };
+
+    template<typename T>
+    class Future
+    {
+        template<typename U>
+        friend class Promise;
+        friend class TaskGroup;
+    public:
+        Future() = default;
+        bool Valid() const
+        {
+            return bool(state_);
+        }
+        bool IsReady() const
+        {
+            return state_->IsReady();
+        }
+        void Wait() const
+        {
+            state_->Wait();
+        }
+        // blocks until ready, then returns the value or rethrows; the future is consumed
+        T Get()
+        {
+            auto state = std::move(state_);
+            state->Wait();
+            return state->Take();
+        }
+        // when this future completes, post fn (taking the value, or nothing for void) to
+        // pool without blocking any thread; errors skip fn and flow into the returned future
+        // the future is consumed
+        template<typename P, typename F>
+        auto Then(P& pool, F&& fn)
+        {
+            return Then_(pool, std::forward<F>(fn));
+        }
+        // the same, with hint passed on to pool.Post (a CostHint for ThreadPool)
+        template<typename P, typename H, typename F>
+        auto Then(P& pool, H hint, F&& fn)
+        {
+            return Then_(pool, std::forward<F>(fn), hint);
+        }
+    private:
+        explicit Future(std::shared_ptr<detail::SharedState<T>> state) : state_{ std::move(state) } {}
+        template<typename P, typename F, typename...H>
+        auto Then_(P& pool, F&& fn, H...hint)
+        {
+            using Result = typename detail::ContinuationResult<T, F>::type;
+            Promise<Result> promise;
+            auto next = promise.GetFuture();
+            auto* antecedent = state_.get();
+            antecedent->OnReady([&pool, state = std::move(state_), promise = std::move(promise), fn = std::forward<F>(fn), ...hint = hint]() mutable {
+                if (state->GetException()) {
+                    promise.SetException(state->GetException());
+                    return;
+                }
+                pool.Post([state = std::move(state), promise = std::move(promise), fn = std::move(fn)]() mutable {
+                    promise.Fulfill([&]() -> Result {
+                        if constexpr (std::is_void_v<T>) {
+                            return std::invoke(std::move(fn));
+                        }
+                        else {
+                            return std::invoke(std::move(fn), state->Take());
+                        }
+                    });
+                }, hint...);
+            });
+            return next;
+        }
+        std::shared_ptr<detail::SharedState<T>> state_;
+    };
+}
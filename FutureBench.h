@@ -0,0 +1,74 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "AllocCounter.h"
+#include "Constants.h"
+#include "ThreadPool.h"
+
+// RunFutureBenchmark: a million tiny tasks submitted with one future each (fan-out), then every
+// result collected (fan-in), with tk::Future/Promise against std::future/std::packaged_task
+
+void RunFutureBenchmark()
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr size_t nTasks = 1'000'000;
+    const auto nWorkers = std::max<size_t>(ComputeCount, 1);
+    const auto ms = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    std::cout << "workers: " << nWorkers << ", tasks: " << nTasks << ", milliseconds" << std::endl;
+    NoteAllocationCounting();
+    std::cout << std::setw(12) << "future" << " | " << std::setw(9) << "fan-out" << " | " << std::setw(9) << "fan-in"
+        << " | " << std::setw(9) << "total" << " | " << std::setw(11) << "allocations" << std::endl;
+    const auto report = [&](const char* name, Clock::duration out, Clock::duration in, size_t allocations) {
+        std::cout << std::setw(12) << name << " | " << std::fixed << std::setprecision(1) << std::setw(9) << ms(out)
+            << " | " << std::setw(9) << ms(in) << " | " << std::setw(9) << ms(out + in) << " | " << std::setw(11) << allocations << std::endl;
+    };
+    for (size_t round = 0; round < 2; round++) {
+        {
+            tk::ThreadPool pool{ nWorkers };
+            std::vector<tk::Future<unsigned>> futures;
+            futures.reserve(nTasks);
+            const auto allocations = HeapAllocations.load();
+            const auto start = Clock::now();
+            for (size_t i = 0; i < nTasks; i++) {
+                futures.push_back(pool.Run([i] { return unsigned(i); }));
+            }
+            const auto submitted = Clock::now();
+            uint64_t sum = 0;
+            for (auto& f : futures) {
+                sum += f.Get();
+            }
+            const auto done = Clock::now();
+            report("tk::Future", submitted - start, done - submitted, HeapAllocations.load() - allocations);
+            if (sum != uint64_t(nTasks) * (nTasks - 1) / 2) {
+                std::cout << "wrong sum" << std::endl;
+            }
+        }
+        {
+            tk::ThreadPool pool{ nWorkers };
+            std::vector<std::future<unsigned>> futures;
+            futures.reserve(nTasks);
+            const auto allocations = HeapAllocations.load();
+            const auto start = Clock::now();
+            for (size_t i = 0; i < nTasks; i++) {
+                std::packaged_task<unsigned()> task{ [i] { return unsigned(i); } };
+                futures.push_back(task.get_future());
+                pool.Post(std::move(task));
+            }
+            const auto submitted = Clock::now();
+            uint64_t sum = 0;
+            for (auto& f : futures) {
+                sum += f.get();
+            }
+            const auto done = Clock::now();
+            report("std::future", submitted - start, done - submitted, HeapAllocations.load() - allocations);
+            if (sum != uint64_t(nTasks) * (nTasks - 1) / 2) {
+                std::cout << "wrong sum" << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Cancel.h"
+#include "Future.h"
+#include "ThreadPool.h"
+
+namespace tk
+{
+    // a dependency graph of steps, each bound to the pool it runs on, built once and then run
+    // any number of times (concurrently, too), once per context such as a dataset item
+    // every run gets its own dependency counters; a finishing node counts down its successors
+    // and posts the ones that reach zero, except that the first of them bound to its own pool
+    // runs next on the same thread, so a chain on one pool costs a single queue round trip
+    // no thread ever waits on a dependency. nodes can only depend on nodes added before them,
+    // so a graph is acyclic by construction
+    // once a node throws, the remaining nodes of that run are skipped and its future gets the
+    // first exception; a node dropped from its queue (CancelPending, pool shutdown) fails the
+    // run with AbandonError and skips everything downstream without posting anything
+    // the graph must outlive its runs, and must not be changed while any are in flight
+    template<typename Ctx>
+    class Graph
+    {
+    public:
+        using NodeId = uint32_t;
+        Graph() = default;
+        Graph(const Graph&) = delete;
+        Graph& operator=(const Graph&) = delete;
+        // fn(Ctx&) on pool once every node in after has finished
+        // nodes that may run at the same time must not touch the same parts of the context
+        template<typename F>
+        NodeId Add(ThreadPool& pool, F&& fn, std::initializer_list<NodeId> after = {})
+        {
+            return Add(pool, std::forward<F>(fn), after, nullptr);
+        }
+        // the same, the node queued with the CostHint costOf(ctx) returns when it is posted; other
+        // nodes of the run may be going at the time, so costOf should only read what none of them write
+        template<typename F, typename C>
+        NodeId Add(ThreadPool& pool, F&& fn, std::initializer_list<NodeId> after, C&& costOf)
+        {
+            const auto id = NodeId(nodes_.size());
+            for (const auto d : after) {
+                if (d >= id) {
+                    throw std::out_of_range{ "graph node depends on a node that does not exist yet" };
+                }
+            }
+            auto& node = nodes_.emplace_back(&pool, std::function<void(Ctx&)>(std::forward<F>(fn)));
+            if constexpr (!std::is_null_pointer_v<std::decay_t<C>>) {
+                node.cost = std::forward<C>(costOf);
+            }
+            for (const auto d : after) {
+                nodes_[d].successors.push_back(id);
+                node.dependencies++;
+            }
+            if (node.dependencies == 0) {
+                roots_.push_back(id);
+            }
+            return id;
+        }
+        size_t Size() const
+        {
+            return nodes_.size();
+        }
+        // starts one run over ctx; the future yields the context once every node has run
+        Future<Ctx> Run(Ctx ctx) const
+        {
+            auto run = std::make_unique<RunState_>(*this, std::move(ctx));
+            auto future = run->promise.GetFuture();
+            if (nodes_.empty()) {
+                run->promise.SetValue(std::move(run->ctx));
+                return future;
+            }
+            // the run frees itself when its last node finishes, which can't be before every root ran
+            auto* state = run.release();
+            for (const auto root : roots_) {
+                Schedule_(state, root);
+            }
+            return future;
+        }
+    private:
+        static constexpr NodeId none_ = std::numeric_limits<NodeId>::max();
+        struct Node_
+        {
+            Node_(ThreadPool* pool, std::function<void(Ctx&)> fn) : pool{ pool }, fn{ std::move(fn) } {}
+            ThreadPool* pool;
+            std::function<void(Ctx&)> fn;
+            std::function<CostHint(const Ctx&)> cost;
+            std::vector<NodeId> successors;
+            uint32_t dependencies = 0;
+        };
+        struct RunState_
+        {
+            RunState_(const Graph& graph, Ctx ctx)
+                : graph{ graph }, ctx{ std::move(ctx) }, pending(graph.nodes_.size()), remaining{ graph.nodes_.size() }
+            {
+                for (size_t i = 0; i < pending.size(); i++) {
+                    pending[i].store(graph.nodes_[i].dependencies, std::memory_order_relaxed);
+                }
+            }
+            // keeps the first error; its write is published by the failing node's countdown
+            void Fail(std::exception_ptr error)
+            {
+                if (!failed.exchange(true, std::memory_order_acq_rel)) {
+                    exception = std::move(error);
+                }
+            }
+            const Graph& graph;
+            Ctx ctx;
+            std::vector<std::atomic<uint32_t>> pending;
+            std::atomic<size_t> remaining;
+            std::atomic<bool> failed = false;
+            std::exception_ptr exception;
+            Promise<Ctx> promise;
+        };
+        // the queued form of a node; dropped unrun, it fails the run instead of stranding it
+        class Ticket_
+        {
+        public:
+            Ticket_(RunState_* run, NodeId node) : run_{ run }, node_{ node } {}
+            Ticket_(Ticket_&& other) noexcept : run_{ std::exchange(other.run_, nullptr) }, node_{ other.node_ } {}
+            Ticket_& operator=(Ticket_&&) = delete;
+            ~Ticket_()
+            {
+                if (run_) {
+                    run_->Fail(detail::AbandonError());
+                    Skip_(run_, node_);
+                }
+            }
+            void operator()()
+            {
+                Execute_(std::exchange(run_, nullptr), node_);
+            }
+        private:
+            RunState_* run_;
+            NodeId node_;
+        };
+
+        static void Schedule_(RunState_* run, NodeId node)
+        {
+            const auto& n = run->graph.nodes_[node];
+            n.pool->Post(Ticket_{ run, node }, n.cost ? n.cost(run->ctx) : CostHint{});
+        }
+        static void Execute_(RunState_* run, NodeId node)
+        {
+            const auto& nodes = run->graph.nodes_;
+            while (node != none_) {
+                const auto& n = nodes[node];
+                if (!run->failed.load(std::memory_order_acquire)) {
+                    try {
+                        n.fn(run->ctx);
+                    }
+                    catch (...) {
+                        run->Fail(std::current_exception());
+                    }
+                }
+                NodeId next = none_;
+                for (const auto s : n.successors) {
+                    if (run->pending[s].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        if (next == none_ && nodes[s].pool == n.pool) {
+                            next = s;
+                        }
+                        else {
+                            Schedule_(run, s);
+                        }
+                    }
+                }
+                // next has not finished, so the run can only complete here when there is none
+                Finish_(run);
+                node = next;
+            }
+        }
+        // counts node and everything it unblocks down on this thread, running none of them
+        static void Skip_(RunState_* run, NodeId node)
+        {
+            std::vector<NodeId> ready{ node };
+            while (!ready.empty()) {
+                const auto n = ready.back();
+                ready.pop_back();
+                for (const auto s : run->graph.nodes_[n].successors) {
+                    if (run->pending[s].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        ready.push_back(s);
+                    }
+                }
+                Finish_(run);
+            }
+        }
+        static void Finish_(RunState_* run)
+        {
+            if (run->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                return;
+            }
+            std::unique_ptr<RunState_> owned{ run };
+            if (owned->exception) {
+                owned->promise.SetException(std::move(owned->exception));
+            }
+            else {
+                owned->promise.SetValue(std::move(owned->ctx));
+            }
+        }
+
+        std::vector<Node_> nodes_;
+        std::vector<NodeId> roots_;
+    };
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "AllocCounter.h"
+#include "ChiliTimer.h"
+#include "Constants.h"
+#include "Graph.h"
+#include "ThreadPool.h"
+
+// RunGraphBenchmark: scheduling overhead per node of tk::Graph runs with empty node bodies, for a
+// chain and a fork-join on one pool and across two, against posting the same number of tasks
+
+void RunGraphBenchmark()
+{
+    constexpr size_t nRuns = 200'000;
+    constexpr size_t nNodes = 6;
+    const auto nWorkers = std::max<size_t>(ComputeCount, 1);
+    // each node marks its own slot, so parallel branches never share one
+    struct Marks
+    {
+        uint8_t hit[nNodes] = {};
+    };
+    const auto mark = [](size_t i) { return [i](Marks& m) { m.hit[i]++; }; };
+    tk::ThreadPool asyncPool{ nWorkers };
+    tk::ThreadPool computePool{ nWorkers };
+    tk::Graph<Marks> chain;
+    for (size_t i = 0; i < nNodes; i++) {
+        i == 0 ? chain.Add(computePool, mark(i)) : chain.Add(computePool, mark(i), { tk::Graph<Marks>::NodeId(i - 1) });
+    }
+    // fetch, four independent stages, merge
+    const auto forkJoin = [&](tk::Graph<Marks>& g, tk::ThreadPool& fetchPool) {
+        const auto fetch = g.Add(fetchPool, mark(0));
+        std::vector<tk::Graph<Marks>::NodeId> stages;
+        for (size_t i = 1; i < nNodes - 1; i++) {
+            stages.push_back(g.Add(computePool, mark(i), { fetch }));
+        }
+        g.Add(computePool, mark(nNodes - 1), { stages[0], stages[1], stages[2], stages[3] });
+    };
+    tk::Graph<Marks> onePool;
+    forkJoin(onePool, computePool);
+    tk::Graph<Marks> twoPools;
+    forkJoin(twoPools, asyncPool);
+
+    std::cout << "workers: " << nWorkers << " per pool, runs: " << nRuns << ", nodes per run: " << nNodes << std::endl;
+    NoteAllocationCounting();
+    std::cout << std::setw(20) << "graph" << " | " << std::setw(8) << "ms" << " | " << std::setw(8) << "ns/node"
+        << " | " << std::setw(15) << "allocs per run" << std::endl;
+    const auto report = [&](const char* name, double seconds, size_t allocations) {
+        std::cout << std::setw(20) << name << " | " << std::fixed << std::setprecision(1) << std::setw(8) << seconds * 1e3
+            << " | " << std::setw(8) << seconds * 1e9 / double(nRuns * nNodes) << " | " << std::setw(15)
+            << std::setprecision(2) << double(allocations) / double(nRuns) << std::endl;
+    };
+    const auto measure = [&](const char* name, const tk::Graph<Marks>& graph) {
+        std::vector<tk::Future<Marks>> runs;
+        runs.reserve(nRuns);
+        const auto allocationsBefore = HeapAllocations.load();
+        ChiliTimer timer;
+        for (size_t r = 0; r < nRuns; r++) {
+            runs.push_back(graph.Run({}));
+        }
+        size_t missed = 0;
+        for (auto& run : runs) {
+            const auto marks = run.Get();
+            missed += std::ranges::count_if(marks.hit, [](uint8_t h) { return h != 1; });
+        }
+        const auto time = timer.Peek();
+        if (name) {
+            report(name, time, HeapAllocations.load() - allocationsBefore);
+        }
+        if (missed) {
+            std::cout << missed << " nodes did not run exactly once" << std::endl;
+        }
+    };
+    // unreported pass so worker start-up and block caches are out of the way
+    measure(nullptr, twoPools);
+    measure("chain, one pool", chain);
+    measure("fork-join, one pool", onePool);
+    measure("fork-join, two pools", twoPools);
+    // the same nodes as plain fire-and-forget tasks, with no dependencies between them
+    {
+        std::atomic<size_t> executed = 0;
+        const auto allocationsBefore = HeapAllocations.load();
+        ChiliTimer timer;
+        for (size_t i = 0; i < nRuns * nNodes; i++) {
+            computePool.Post([&executed] { executed.fetch_add(1, std::memory_order_relaxed); });
+        }
+        computePool.WaitForAllDone();
+        report("posted tasks", timer.Peek(), HeapAllocations.load() - allocationsBefore);
+    }
+}
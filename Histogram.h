@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+namespace tk
+{
+    // HDR-style log-linear buckets: every power of two is split into 2^subBits_ equal
+    // sub-buckets, so a recorded value is known to within 1/16 (6.25%) of itself
+    // values are unitless (the pool records nanoseconds); anything at or past 2^maxBits_
+    // shares the last bucket, but Max() is always exact
+    namespace detail
+    {
+        inline constexpr size_t histogramSubBits = 4;
+        inline constexpr size_t histogramMaxBits = 40;
+        inline constexpr size_t histogramSubCount = size_t(1) << histogramSubBits;
+        inline constexpr size_t histogramBuckets = (histogramMaxBits - histogramSubBits + 1) * histogramSubCount;
+
+        constexpr size_t HistogramBucket(uint64_t value)
+        {
+            if (value < histogramSubCount) {
+                return size_t(value);
+            }
+            const auto exponent = size_t(std::bit_width(value)) - 1;
+            if (exponent >= histogramMaxBits) {
+                return histogramBuckets - 1;
+            }
+            const auto sub = size_t(value >> (exponent - histogramSubBits)) - histogramSubCount;
+            return (exponent - histogramSubBits + 1) * histogramSubCount + sub;
+        }
+        // largest value that lands in bucket
+        constexpr uint64_t HistogramBucketTop(size_t bucket)
+        {
+            if (bucket < histogramSubCount) {
+                return bucket;
+            }
+            const auto exponent = bucket / histogramSubCount + histogramSubBits - 1;
+            const auto sub = bucket % histogramSubCount;
+            const auto width = uint64_t(1) << (exponent - histogramSubBits);
+            return ((histogramSubCount + sub) << (exponent - histogramSubBits)) + width - 1;
+        }
+    }
+
+    // point-in-time copy of one or more histograms
+    class HistogramSnapshot
+    {
+    public:
+        HistogramSnapshot() : counts_(detail::histogramBuckets) {}
+        uint64_t Count() const
+        {
+            return count_;
+        }
+        uint64_t Max() const
+        {
+            return max_;
+        }
+        double Mean() const
+        {
+            return count_ ? double(sum_) / double(count_) : 0.;
+        }
+        // upper bound of the bucket holding quantile q (0..1), capped at Max()
+        uint64_t Percentile(double q) const
+        {
+            if (count_ == 0) {
+                return 0;
+            }
+            const auto rank = std::max<uint64_t>(uint64_t(q * double(count_) + .5), 1);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < counts_.size(); i++) {
+                seen += counts_[i];
+                if (seen >= rank) {
+                    return std::min(detail::HistogramBucketTop(i), max_);
+                }
+            }
+            return max_;
+        }
+        void Merge(const HistogramSnapshot& other)
+        {
+            for (size_t i = 0; i < counts_.size(); i++) {
+                counts_[i] += other.counts_[i];
+            }
+            count_ += other.count_;
+            sum_ += other.sum_;
+            max_ = std::max(max_, other.max_);
+        }
+    private:
+        friend class Histogram;
+        std::vector<uint64_t> counts_;
+        uint64_t count_ = 0;
+        uint64_t sum_ = 0;
+        uint64_t max_ = 0;
+    };
+
+    // single-writer histogram: Record must only ever be called from one thread, which lets
+    // it bump counters with plain relaxed load/store pairs (no locked instructions) while
+    // Snapshot reads them from any thread
+    class Histogram
+    {
+    public:
+        void Record(uint64_t value)
+        {
+            Bump_(counts_[detail::HistogramBucket(value)], 1);
+            Bump_(count_, 1);
+            Bump_(sum_, value);
+            if (value > max_.load(std::memory_order_relaxed)) {
+                max_.store(value, std::memory_order_relaxed);
+            }
+        }
+        // counters are read one by one while the writer keeps going, so a snapshot taken
+        // mid-run can be off by the handful of records that land during the copy
+        HistogramSnapshot Snapshot() const
+        {
+            HistogramSnapshot snap;
+            for (size_t i = 0; i < counts_.size(); i++) {
+                snap.counts_[i] = counts_[i].load(std::memory_order_relaxed);
+            }
+            snap.count_ = count_.load(std::memory_order_relaxed);
+            snap.sum_ = sum_.load(std::memory_order_relaxed);
+            snap.max_ = max_.load(std::memory_order_relaxed);
+            return snap;
+        }
+    private:
+        static void Bump_(std::atomic<uint64_t>& counter, uint64_t by)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+        std::array<std::atomic<uint64_t>, detail::histogramBuckets> counts_{};
+        std::atomic<uint64_t> count_ = 0;
+        std::atomic<uint64_t> sum_ = 0;
+        std::atomic<uint64_t> max_ = 0;
+    };
+}
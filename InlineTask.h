@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace tk
+{
+    // move-only void() callable that stores small callables in place; only callables larger
+    // than inlineSize (or with throwing moves) fall back to the heap
+    class InlineTask
+    {
+    public:
+        static constexpr size_t inlineSize = 48;
+
+        InlineTask() noexcept = default;
+        InlineTask(std::nullptr_t) noexcept {}
+        template<typename F>
+            requires (!std::is_same_v<std::remove_cvref_t<F>, InlineTask> && std::is_invocable_v<std::remove_cvref_t<F>&>)
+        InlineTask(F&& function)
+        {
+            using Fn = std::remove_cvref_t<F>;
+            if constexpr (FitsInline_<Fn>()) {
+                ::new (static_cast<void*>(storage_)) Fn(std::forward<F>(function));
+                vtable_ = &inlineVTable_<Fn>;
+            }
+            else {
+                ::new (static_cast<void*>(storage_)) Fn*(new Fn(std::forward<F>(function)));
+                vtable_ = &heapVTable_<Fn>;
+            }
+        }
+        InlineTask(InlineTask&& other) noexcept
+        {
+            MoveFrom_(other);
+        }
+        InlineTask& operator=(InlineTask&& other) noexcept
+        {
+            if (this != &other) {
+                Reset_();
+                MoveFrom_(other);
+            }
+            return *this;
+        }
+        ~InlineTask()
+        {
+            Reset_();
+        }
+        explicit operator bool() const noexcept
+        {
+            return vtable_ != nullptr;
+        }
+        void operator()()
+        {
+            vtable_->invoke(storage_);
+        }
+
+    private:
+        // types
+        struct VTable_
+        {
+            void(*invoke)(void* storage);
+            void(*move)(void* from, void* to) noexcept;
+            void(*destroy)(void* storage) noexcept;
+        };
+        // functions
+        template<typename Fn>
+        static constexpr bool FitsInline_()
+        {
+            return sizeof(Fn) <= inlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+                std::is_nothrow_move_constructible_v<Fn>;
+        }
+        void MoveFrom_(InlineTask& other) noexcept
+        {
+            if (other.vtable_) {
+                other.vtable_->move(other.storage_, storage_);
+                vtable_ = std::exchange(other.vtable_, nullptr);
+            }
+        }
+        void Reset_() noexcept
+        {
+            if (vtable_) {
+                vtable_->destroy(storage_);
+                vtable_ = nullptr;
+            }
+        }
+        // data
+        template<typename Fn>
+        static constexpr VTable_ inlineVTable_{
+            [](void* storage) { (*std::launder(static_cast<Fn*>(storage)))(); },
+            [](void* from, void* to) noexcept {
+                auto* fn = std::launder(static_cast<Fn*>(from));
+                ::new (to) Fn(std::move(*fn));
+                fn->~Fn();
+            },
+            [](void* storage) noexcept { std::launder(static_cast<Fn*>(storage))->~Fn(); },
+        };
+        template<typename Fn>
+        static constexpr VTable_ heapVTable_{
+            [](void* storage) { (**std::launder(static_cast<Fn**>(storage)))(); },
+            [](void* from, void* to) noexcept { ::new (to) Fn*(*std::launder(static_cast<Fn**>(from))); },
+            [](void* storage) noexcept { delete *std::launder(static_cast<Fn**>(storage)); },
+        };
+        alignas(std::max_align_t) std::byte storage_[inlineSize];
+        const VTable_* vtable_ = nullptr;
+    };
+}
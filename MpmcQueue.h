@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+
+namespace tk
+{
+    // bounded multi-producer multi-consumer ring (Dmitry Vyukov's design)
+    // each cell carries a sequence number that tells producers and consumers whose turn it is,
+    // so the only contended operations are one CAS on the enqueue or dequeue cursor
+    template<typename T>
+    class MpmcQueue
+    {
+    public:
+        // capacity is rounded up to a power of two
+        explicit MpmcQueue(size_t capacity)
+            :
+            mask_{ std::bit_ceil(capacity < 2 ? size_t(2) : capacity) - 1 },
+            cells_{ std::make_unique<Cell_[]>(mask_ + 1) }
+        {
+            for (size_t i = 0; i <= mask_; i++) {
+                cells_[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+        // value is only moved from when the push succeeds; false means the ring is full
+        bool TryPush(T&& value)
+        {
+            auto pos = enqueuePos_.load(std::memory_order_relaxed);
+            for (;;) {
+                auto& cell = cells_[pos & mask_];
+                const auto seq = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = intptr_t(seq) - intptr_t(pos);
+                if (diff == 0) {
+                    if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    return false;
+                }
+                else {
+                    pos = enqueuePos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        // all-or-nothing: claims values.size() consecutive cells with a single CAS on the
+        // enqueue cursor; values are only moved from when the push succeeds
+        bool TryPushBulk(std::span<T> values)
+        {
+            const auto n = values.size();
+            if (n > Capacity()) {
+                return false;
+            }
+            auto pos = enqueuePos_.load(std::memory_order_relaxed);
+            for (;;) {
+                bool raced = false;
+                for (size_t i = 0; i < n; i++) {
+                    const auto seq = cells_[(pos + i) & mask_].sequence.load(std::memory_order_acquire);
+                    const auto diff = intptr_t(seq) - intptr_t(pos + i);
+                    if (diff < 0) {
+                        return false;
+                    }
+                    if (diff > 0) {
+                        raced = true;
+                        break;
+                    }
+                }
+                if (raced) {
+                    pos = enqueuePos_.load(std::memory_order_relaxed);
+                }
+                else if (enqueuePos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                    for (size_t i = 0; i < n; i++) {
+                        auto& cell = cells_[(pos + i) & mask_];
+                        cell.value = std::move(values[i]);
+                        cell.sequence.store(pos + i + 1, std::memory_order_release);
+                    }
+                    return true;
+                }
+            }
+        }
+        std::optional<T> TryPop()
+        {
+            auto pos = dequeuePos_.load(std::memory_order_relaxed);
+            for (;;) {
+                auto& cell = cells_[pos & mask_];
+                const auto seq = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = intptr_t(seq) - intptr_t(pos + 1);
+                if (diff == 0) {
+                    if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        std::optional<T> value{ std::move(cell.value) };
+                        cell.value = T{};
+                        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                        return value;
+                    }
+                }
+                else if (diff < 0) {
+                    return std::nullopt;
+                }
+                else {
+                    pos = dequeuePos_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+        size_t Capacity() const
+        {
+            return mask_ + 1;
+        }
+    private:
+        // types
+        struct Cell_
+        {
+            std::atomic<size_t> sequence;
+            T value{};
+        };
+        // data
+        size_t mask_;
+        std::unique_ptr<Cell_[]> cells_;
+        alignas(64) std::atomic<size_t> enqueuePos_ = 0;
+        alignas(64) std::atomic<size_t> dequeuePos_ = 0;
+    };
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <ranges>
+#include "TaskGroup.h"
+#include "ThreadPool.h"
+
+// data-parallel loops over random-access ranges using lazy binary splitting: one task starts
+// with the whole index range and works through it grain elements at a time; before each grain
+// it checks whether the pool is starved and, if so, hands the upper half of what it has left
+// to a new task. Ranges are therefore only cut as finely as idle workers demand, so cheap
+// elements pay no per-element queue cost, while a cluster of expensive elements still gets
+// split up as soon as the workers that finished their cheap share go idle.
+
+namespace tk
+{
+    namespace detail
+    {
+        template<typename Body>
+        struct SplitContext
+        {
+            ThreadPool& pool;
+            TaskGroup& group;
+            size_t grain;
+            Body& body;
+        };
+
+        template<typename Body>
+        void SplitRange(SplitContext<Body>& ctx, size_t first, size_t last)
+        {
+            while (first < last) {
+                if (last - first > ctx.grain && ctx.pool.IsStarved()) {
+                    const auto mid = first + (last - first) / 2;
+                    ctx.pool.RunIn(ctx.group, [&ctx, mid, last] { SplitRange(ctx, mid, last); });
+                    last = mid;
+                    continue;
+                }
+                for (const auto end = std::min(first + ctx.grain, last); first < end; first++) {
+                    ctx.body(first);
+                }
+            }
+        }
+
+        // the caller blocks until the loop is done without running any of it, so it must not be
+        // one of pool's own workers: with every worker waiting like that, nothing is left to
+        // run the pieces (BlockingRegion only helps an elastic pool below its maximum)
+        template<typename Body>
+        void ParallelIndex(ThreadPool& pool, size_t count, size_t grain, Body& body)
+        {
+            assert(ThreadPool::Current() != &pool && "ParallelFor/ParallelTransform called from a task on the same pool");
+            TaskGroup group;
+            SplitContext<Body> ctx{ pool, group, std::max<size_t>(grain, 1), body };
+            pool.RunIn(group, [&ctx, count] { SplitRange(ctx, 0, count); });
+            group.Wait();
+        }
+    }
+
+    // fn(element) for every element; blocks until done and rethrows the first exception
+    // not to be called from a task running on pool itself (see ParallelIndex)
+    template<std::ranges::random_access_range R, typename F>
+        requires std::ranges::sized_range<R>
+    void ParallelFor(ThreadPool& pool, R&& range, F&& fn, size_t grain = 1)
+    {
+        const auto first = std::ranges::begin(range);
+        auto body = [&](size_t i) { std::invoke(fn, first[i]); };
+        detail::ParallelIndex(pool, size_t(std::ranges::size(range)), grain, body);
+    }
+
+    // out[i] = fn(in[i]); out must have at least as many elements as in; blocks like ParallelFor
+    template<std::ranges::random_access_range I, std::ranges::random_access_range O, typename F>
+        requires std::ranges::sized_range<I>
+    void ParallelTransform(ThreadPool& pool, I&& in, O&& out, F&& fn, size_t grain = 1)
+    {
+        const auto src = std::ranges::begin(in);
+        const auto dst = std::ranges::begin(out);
+        auto body = [&](size_t i) { dst[i] = std::invoke(fn, src[i]); };
+        detail::ParallelIndex(pool, size_t(std::ranges::size(in)), grain, body);
+    }
+}
@@ -0,0 +1,390 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "AllocCounter.h"
+#include "ChiliTimer.h"
+#include "Constants.h"
+#include "MpmcQueue.h"
+#include "Task.h"
+#include "ThreadPool.h"
+
+// microbenchmarks for the submission path
+// RunQueueBenchmark: contention sweep, producer count goes from 1 to AsyncCount while
+// ComputeCount consumers drain, reporting submit and dequeue throughput (million ops per
+// second) for the bare queues and for ThreadPool::Run in every QueueMode
+// RunSubmitBenchmark: steady-state ThreadPool::Run throughput from one producer, with the
+// number of heap allocations made while measuring
+// RunScheduleBenchmark: makespan of the random, even and stacked datasets (and stacked reversed) on ComputeCount
+// workers with FIFO (Shared) against cost-ordered (Priority) scheduling
+// RunWakeBenchmark: submit-to-start latency of a lone task submitted to an idle pool, for each
+// QueueMode under a few IdlePolicy settings
+// RunCancelBenchmark: CancelPending on pools whose workers are all busy and whose queues hold a
+// large backlog: time spent inside the call and time until the pool is quiescent again
+
+namespace bench
+{
+    struct Throughput
+    {
+        double submitMops;
+        double dequeueMops;
+    };
+
+    class LockedDeque
+    {
+    public:
+        bool TryPush(size_t&& v)
+        {
+            std::lock_guard lk{ mtx_ };
+            items_.push_back(v);
+            return true;
+        }
+        std::optional<size_t> TryPop()
+        {
+            std::lock_guard lk{ mtx_ };
+            if (items_.empty()) {
+                return std::nullopt;
+            }
+            const auto v = items_.front();
+            items_.pop_front();
+            return v;
+        }
+    private:
+        std::mutex mtx_;
+        std::deque<size_t> items_;
+    };
+
+    // list scheduling in cost units: each task goes to the worker that frees up first
+    inline double SimulateMakespan(const std::vector<double>& costs, size_t nWorkers)
+    {
+        std::priority_queue<double, std::vector<double>, std::greater<>> freeAt;
+        for (size_t i = 0; i < nWorkers; i++) {
+            freeAt.push(0.);
+        }
+        double makespan = 0.;
+        for (const auto cost : costs) {
+            const auto start = freeAt.top();
+            freeAt.pop();
+            freeAt.push(start + cost);
+            makespan = std::max(makespan, start + cost);
+        }
+        return makespan;
+    }
+
+    inline float MeasureMakespan(tk::QueueMode mode, const Dataset& tasks, size_t nWorkers)
+    {
+        tk::ThreadPool pool{ nWorkers, mode };
+        std::vector<tk::Future<unsigned int>> results;
+        results.reserve(tasks.size());
+        ChiliTimer timer;
+        for (const auto& task : tasks) {
+            const double cost = double(task.heavy ? HeavyIterations : LightIterations);
+            results.push_back(pool.Run(tk::CostHint{ cost }, [&task] { return task.Process(); }));
+        }
+        for (auto& result : results) {
+            result.Get();
+        }
+        return timer.Peek();
+    }
+
+    template<class Q>
+    Throughput MeasureQueue(Q& queue, size_t nProducers, size_t nConsumers, size_t nItems)
+    {
+        const auto perProducer = nItems / nProducers;
+        const auto total = perProducer * nProducers;
+        std::atomic<size_t> consumed = 0;
+        std::atomic<size_t> producersLeft = nProducers;
+        std::atomic<bool> go = false;
+        float submitTime = 0.f;
+        ChiliTimer timer;
+        {
+            std::vector<std::jthread> threads;
+            for (size_t p = 0; p < nProducers; p++) {
+                threads.emplace_back([&] {
+                    go.wait(false);
+                    for (size_t i = 0; i < perProducer; i++) {
+                        while (!queue.TryPush(size_t(i))) {
+                            std::this_thread::yield();
+                        }
+                    }
+                    if (--producersLeft == 0) {
+                        submitTime = timer.Peek();
+                    }
+                });
+            }
+            for (size_t c = 0; c < nConsumers; c++) {
+                threads.emplace_back([&] {
+                    go.wait(false);
+                    while (consumed.load(std::memory_order_relaxed) < total) {
+                        if (queue.TryPop()) {
+                            consumed.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        else {
+                            std::this_thread::yield();
+                        }
+                    }
+                });
+            }
+            timer.Mark();
+            go = true;
+            go.notify_all();
+        }
+        const auto dequeueTime = timer.Peek();
+        return { total / submitTime / 1e6, total / dequeueTime / 1e6 };
+    }
+
+    inline Throughput MeasurePool(tk::QueueMode mode, size_t nProducers, size_t nConsumers, size_t nItems)
+    {
+        const auto perProducer = nItems / nProducers;
+        const auto total = perProducer * nProducers;
+        std::atomic<size_t> executed = 0;
+        std::atomic<size_t> producersLeft = nProducers;
+        std::atomic<bool> go = false;
+        float submitTime = 0.f;
+        tk::ThreadPool pool{ nConsumers, mode };
+        ChiliTimer timer;
+        {
+            std::vector<std::jthread> producers;
+            for (size_t p = 0; p < nProducers; p++) {
+                producers.emplace_back([&] {
+                    go.wait(false);
+                    for (size_t i = 0; i < perProducer; i++) {
+                        pool.Run([&executed] { executed.fetch_add(1, std::memory_order_relaxed); });
+                    }
+                    if (--producersLeft == 0) {
+                        submitTime = timer.Peek();
+                    }
+                });
+            }
+            timer.Mark();
+            go = true;
+            go.notify_all();
+        }
+        while (executed.load(std::memory_order_relaxed) < total) {
+            std::this_thread::yield();
+        }
+        const auto dequeueTime = timer.Peek();
+        return { total / submitTime / 1e6, total / dequeueTime / 1e6 };
+    }
+}
+
+namespace bench
+{
+    struct WakeLatency
+    {
+        // submit to start, microseconds
+        double p50;
+        double p90;
+        double p99;
+        // time spent inside Post, nanoseconds
+        double submitNs;
+    };
+
+    // one task at a time: submit, wait for it to run, let the workers go idle for gap, repeat
+    inline WakeLatency MeasureWake(tk::QueueMode mode, tk::IdlePolicy policy, size_t nWorkers, size_t nRounds,
+        std::chrono::microseconds gap)
+    {
+        using Clock = std::chrono::steady_clock;
+        tk::ThreadPool pool{ nWorkers, mode };
+        pool.SetIdlePolicy(policy);
+        std::atomic<bool> ran = false;
+        Clock::duration submitTime{};
+        for (size_t i = 0; i < nRounds; i++) {
+            const auto until = Clock::now() + gap;
+            while (Clock::now() < until) {
+                std::this_thread::yield();
+            }
+            ran.store(false, std::memory_order_relaxed);
+            const auto before = Clock::now();
+            pool.Post([&ran] { ran.store(true, std::memory_order_release); });
+            submitTime += Clock::now() - before;
+            while (!ran.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+        // the last task's stats are recorded just after it signals
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+        const auto wait = pool.GetStats().queueWait;
+        return { double(wait.Percentile(.5)) / 1000., double(wait.Percentile(.9)) / 1000., double(wait.Percentile(.99)) / 1000.,
+            double(std::chrono::duration_cast<std::chrono::nanoseconds>(submitTime).count()) / double(nRounds) };
+    }
+}
+
+void RunQueueBenchmark()
+{
+    constexpr size_t queueItems = 1 << 21;
+    constexpr size_t poolItems = 1 << 18;
+    const auto nConsumers = std::max<size_t>(ComputeCount, 1);
+
+    std::cout << "consumers: " << nConsumers << ", throughput in Mops/s (submit / dequeue)\n";
+    std::cout << std::setw(9) << "producers";
+    for (auto name : { "mutex deque", "mpmc ring", "pool shared", "pool stealing", "pool lockfree" }) {
+        std::cout << " | " << std::setw(17) << name;
+    }
+    std::cout << std::endl;
+    const auto print = [](bench::Throughput t) {
+        std::cout << " | " << std::fixed << std::setprecision(2)
+            << std::setw(8) << t.submitMops << '/' << std::left << std::setw(8) << t.dequeueMops << std::right;
+    };
+    for (size_t nProducers = 1; nProducers <= std::max<size_t>(AsyncCount, 1); nProducers *= 2) {
+        bench::LockedDeque locked;
+        tk::MpmcQueue<size_t> ring{ 1 << 14 };
+        std::cout << std::setw(9) << nProducers;
+        print(bench::MeasureQueue(locked, nProducers, nConsumers, queueItems));
+        print(bench::MeasureQueue(ring, nProducers, nConsumers, queueItems));
+        print(bench::MeasurePool(tk::QueueMode::Shared, nProducers, nConsumers, poolItems));
+        print(bench::MeasurePool(tk::QueueMode::WorkStealing, nProducers, nConsumers, poolItems));
+        print(bench::MeasurePool(tk::QueueMode::LockFree, nProducers, nConsumers, poolItems));
+        std::cout << std::endl;
+    }
+}
+
+void RunSubmitBenchmark()
+{
+    // in-flight work is capped so queues stay at a steady depth instead of growing with the
+    // run, and the warmup lets rings, block caches and the depot reach that working size first
+    constexpr size_t nWarmup = 1 << 18;
+    constexpr size_t nMeasured = 1 << 20;
+    constexpr size_t maxInFlight = 1 << 12;
+    const auto nConsumers = std::max<size_t>(ComputeCount, 1);
+
+    std::cout << "consumers: " << nConsumers << ", submissions: " << nMeasured << ", max in flight: " << maxInFlight << std::endl;
+    NoteAllocationCounting();
+    for (auto [mode, name] : { std::pair{ tk::QueueMode::Shared, "shared" },
+        std::pair{ tk::QueueMode::WorkStealing, "stealing" }, std::pair{ tk::QueueMode::LockFree, "lockfree" } }) {
+        tk::ThreadPool pool{ nConsumers, mode };
+        std::atomic<size_t> executed = 0;
+        size_t submitted = 0;
+        const auto submit = [&](size_t n) {
+            for (size_t i = 0; i < n; i++) {
+                while (submitted - executed.load(std::memory_order_relaxed) >= maxInFlight) {
+                    std::this_thread::yield();
+                }
+                pool.Run([&executed] { executed.fetch_add(1, std::memory_order_relaxed); });
+                submitted++;
+            }
+            while (executed.load(std::memory_order_relaxed) < submitted) {
+                std::this_thread::yield();
+            }
+        };
+        submit(nWarmup);
+        const auto allocationsBefore = HeapAllocations.load();
+        ChiliTimer timer;
+        submit(nMeasured);
+        const auto time = timer.Peek();
+        const auto allocations = HeapAllocations.load() - allocationsBefore;
+        std::cout << std::setw(9) << name << " | " << std::fixed << std::setprecision(2)
+            << std::setw(8) << nMeasured / time / 1e6 << " Mops/s | heap allocations: " << allocations << std::endl;
+    }
+}
+
+void RunScheduleBenchmark()
+{
+    const auto nWorkers = std::max<size_t>(ComputeCount, 1);
+    std::cout << "workers: " << nWorkers << ", tasks: " << DatasetSize << ", makespan in seconds"
+        << " (simulated: in units of the lower bound max(total work / workers, largest task))" << std::endl;
+    std::cout << std::setw(10) << "dataset" << " | " << std::setw(8) << "fifo" << " | " << std::setw(8) << "lpt"
+        << " | " << std::setw(7) << "speedup" << " | " << std::setw(14) << "simulated fifo" << " | " << std::setw(13) << "simulated lpt" << std::endl;
+    // stacked puts the heavy tasks first, which is already LPT order; heavy-last is its reverse
+    for (const std::string_view kind : { "random", "even", "stacked", "heavy-last" }) {
+        auto tasks = GenerateDataset(kind == "heavy-last" ? "stacked" : kind);
+        if (kind == "heavy-last") {
+            std::ranges::reverse(tasks);
+        }
+        std::vector<double> costs;
+        for (const auto& task : tasks) {
+            costs.push_back(double(task.heavy ? HeavyIterations : LightIterations));
+        }
+        const auto bound = std::max(std::reduce(costs.begin(), costs.end()) / double(nWorkers), std::ranges::max(costs));
+        const auto fifoSim = bench::SimulateMakespan(costs, nWorkers) / bound;
+        std::ranges::stable_sort(costs, std::greater<>{});
+        const auto lptSim = bench::SimulateMakespan(costs, nWorkers) / bound;
+        const auto fifo = bench::MeasureMakespan(tk::QueueMode::Shared, tasks, nWorkers);
+        const auto lpt = bench::MeasureMakespan(tk::QueueMode::Priority, tasks, nWorkers);
+        std::cout << std::setw(10) << kind << " | " << std::fixed << std::setprecision(3) << std::setw(8) << fifo
+            << " | " << std::setw(8) << lpt << " | " << std::setprecision(2) << std::setw(6) << fifo / lpt << "x"
+            << " | " << std::setprecision(3) << std::setw(14) << fifoSim << " | " << std::setw(13) << lptSim << std::endl;
+    }
+}
+
+void RunWakeBenchmark()
+{
+    constexpr size_t nRounds = 2'000;
+    constexpr std::chrono::microseconds gap{ 50 };
+    const auto nWorkers = std::max<size_t>(ComputeCount, 1);
+    std::cout << "workers: " << nWorkers << ", rounds: " << nRounds << ", idle gap: " << gap.count()
+        << "us, submit-to-start latency in us, time inside Post in ns" << std::endl;
+    std::cout << std::setw(9) << "mode" << " | " << std::setw(20) << "policy" << " | " << std::setw(8) << "p50"
+        << " | " << std::setw(8) << "p90" << " | " << std::setw(8) << "p99" << " | " << std::setw(9) << "submit ns" << std::endl;
+    for (auto [mode, name] : { std::pair{ tk::QueueMode::Shared, "shared" },
+        std::pair{ tk::QueueMode::WorkStealing, "stealing" }, std::pair{ tk::QueueMode::LockFree, "lockfree" } }) {
+        for (auto [policy, policyName] : { std::pair{ tk::IdlePolicy{}, "park" },
+            std::pair{ tk::IdlePolicy{ .spins = 4'000 }, "spin 4000" },
+            std::pair{ tk::IdlePolicy{ .spins = 4'000, .yields = 100 }, "spin 4000, yield 100" } }) {
+            const auto w = bench::MeasureWake(mode, policy, nWorkers, nRounds, gap);
+            std::cout << std::setw(9) << name << " | " << std::setw(20) << policyName << " | " << std::fixed << std::setprecision(2)
+                << std::setw(8) << w.p50 << " | " << std::setw(8) << w.p90 << " | " << std::setw(8) << w.p99
+                << " | " << std::setprecision(0) << std::setw(9) << w.submitNs << std::endl;
+        }
+    }
+}
+
+void RunCancelBenchmark()
+{
+    using Clock = std::chrono::steady_clock;
+    using namespace std::chrono_literals;
+    constexpr size_t nTasks = 200'000;
+    constexpr auto taskTime = 20us;
+    const auto nWorkers = std::max<size_t>(ComputeCount, 1);
+    const auto us = [](Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); };
+    std::cout << "workers: " << nWorkers << ", queued: " << nTasks << " tasks of " << taskTime.count()
+        << "us, cancelled after 20ms" << std::endl;
+    // last start: the last time a worker started a task, relative to the call (negative when no task
+    // started after it); call: time inside CancelPending, which includes failing every dropped future;
+    // quiet: until WaitForAllDone returned
+    std::cout << std::setw(9) << "mode" << " | " << std::setw(9) << "dropped" << " | " << std::setw(13) << "last start us"
+        << " | " << std::setw(10) << "call us" << " | " << std::setw(10) << "quiet us" << " | " << std::setw(9) << "cancelled" << std::endl;
+    for (auto [mode, name] : { std::pair{ tk::QueueMode::Shared, "shared" }, std::pair{ tk::QueueMode::WorkStealing, "stealing" },
+        std::pair{ tk::QueueMode::LockFree, "lockfree" }, std::pair{ tk::QueueMode::Priority, "lpt" } }) {
+        tk::ThreadPool pool{ nWorkers, mode };
+        std::vector<tk::Future<void>> futures;
+        futures.reserve(nTasks);
+        std::atomic<Clock::rep> lastStart = 0;
+        for (size_t i = 0; i < nTasks; i++) {
+            futures.push_back(pool.Run([taskTime, &lastStart] {
+                const auto now = Clock::now();
+                lastStart.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+                const auto until = now + taskTime;
+                while (Clock::now() < until) {}
+            }));
+        }
+        std::this_thread::sleep_for(20ms);
+        const auto start = Clock::now();
+        const auto dropped = pool.CancelPending();
+        const auto called = Clock::now();
+        pool.WaitForAllDone();
+        const auto quiet = Clock::now();
+        size_t cancelled = 0;
+        for (auto& f : futures) {
+            try {
+                f.Get();
+            }
+            catch (const tk::Cancelled&) {
+                cancelled++;
+            }
+        }
+        const auto last = Clock::time_point{ Clock::duration{ lastStart.load() } };
+        std::cout << std::setw(9) << name << " | " << std::setw(9) << dropped << " | " << std::fixed << std::setprecision(1)
+            << std::setw(13) << us(last - start) << " | " << std::setw(10) << us(called - start) << " | " << std::setw(10) << us(quiet - start)
+            << " | " << std::setw(9) << cancelled << std::endl;
+    }
+}
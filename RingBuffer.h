@@ -0,0 +1,57 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+namespace tk
+{
+    // growable circular double-ended queue; unlike std::deque it keeps its storage when
+    // drained, so a queue that has reached its working size stops allocating
+    // T must be default constructible (vacated slots are reset to T{} to release resources)
+    template<typename T>
+    class RingBuffer
+    {
+    public:
+        bool Empty() const
+        {
+            return size_ == 0;
+        }
+        size_t Size() const
+        {
+            return size_;
+        }
+        void PushBack(T value)
+        {
+            if (size_ == slots_.size()) {
+                Grow_();
+            }
+            slots_[(head_ + size_) & (slots_.size() - 1)] = std::move(value);
+            size_++;
+        }
+        T PopFront()
+        {
+            auto value = std::exchange(slots_[head_], T{});
+            head_ = (head_ + 1) & (slots_.size() - 1);
+            size_--;
+            return value;
+        }
+        T PopBack()
+        {
+            size_--;
+            return std::exchange(slots_[(head_ + size_) & (slots_.size() - 1)], T{});
+        }
+    private:
+        void Grow_()
+        {
+            std::vector<T> bigger(slots_.empty() ? 16 : slots_.size() * 2);
+            for (size_t i = 0; i < size_; i++) {
+                bigger[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+            }
+            slots_ = std::move(bigger);
+            head_ = 0;
+        }
+        // size is always zero or a power of two
+        std::vector<T> slots_;
+        size_t head_ = 0;
+        size_t size_ = 0;
+    };
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <numbers>
+#include <random>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include "Constants.h"
+#include "Task.h"
+
+// struct-of-arrays dataset: values are one contiguous array of doubles and the heavy flags are
+// packed 64 to a word, so 1M tasks take 8MB + 128KB instead of the 16MB of Dataset (where half
+// of every Task is padding) and kernels can stream values with unit stride
+class SoaDataset
+{
+public:
+    SoaDataset() = default;
+    explicit SoaDataset(size_t size)
+        : values_(size), heavyBits_((size + 63) / 64) {}
+    explicit SoaDataset(const Dataset& tasks)
+        : SoaDataset(tasks.size())
+    {
+        for (size_t i = 0; i < tasks.size(); i++) {
+            values_[i] = tasks[i].val;
+            SetHeavy(i, tasks[i].heavy);
+        }
+    }
+    size_t Size() const
+    {
+        return values_.size();
+    }
+    std::span<double> Values()
+    {
+        return values_;
+    }
+    std::span<const double> Values() const
+    {
+        return values_;
+    }
+    // bit i % 64 of word i / 64; bits past Size() are always clear
+    std::span<const uint64_t> HeavyBits() const
+    {
+        return heavyBits_;
+    }
+    bool IsHeavy(size_t i) const
+    {
+        return (heavyBits_[i / 64] >> (i % 64)) & 1;
+    }
+    void SetHeavy(size_t i, bool heavy)
+    {
+        const auto bit = uint64_t(1) << (i % 64);
+        heavyBits_[i / 64] = heavy ? heavyBits_[i / 64] | bit : heavyBits_[i / 64] & ~bit;
+    }
+    size_t HeavyCount() const
+    {
+        size_t count = 0;
+        for (const auto word : heavyBits_) {
+            count += size_t(std::popcount(word));
+        }
+        return count;
+    }
+    Task operator[](size_t i) const
+    {
+        return Task{ .val = values_[i], .heavy = IsHeavy(i) };
+    }
+    // AoS view for code that still takes Tasks; elements are materialized by value
+    auto Tasks() const
+    {
+        return std::views::iota(size_t(0), Size()) | std::views::transform([this](size_t i) { return (*this)[i]; });
+    }
+    Dataset ToTasks() const
+    {
+        Dataset tasks(Size());
+        for (size_t i = 0; i < Size(); i++) {
+            tasks[i] = (*this)[i];
+        }
+        return tasks;
+    }
+    // fn(values, heavy) for every maximal run of items with the same flag, so a kernel gets
+    // a unit-stride span with one iteration count per call
+    template<typename F>
+    void ForEachRun(F&& fn) const
+    {
+        size_t first = 0;
+        while (first < Size()) {
+            const bool heavy = IsHeavy(first);
+            size_t last = first + 1;
+            while (last < Size()) {
+                // skip ahead by however many of the word's remaining bits agree with the run
+                const auto word = heavy ? ~heavyBits_[last / 64] : heavyBits_[last / 64];
+                const auto inWord = 64 - last % 64;
+                const auto same = std::min(size_t(std::countr_zero(word >> (last % 64))), inWord);
+                last = std::min(last + same, Size());
+                if (same < inWord) {
+                    break;
+                }
+            }
+            fn(std::span<const double>{ values_ }.subspan(first, last - first), heavy);
+            first = last;
+        }
+    }
+
+private:
+    std::vector<double> values_;
+    std::vector<uint64_t> heavyBits_;
+};
+
+// same streams of values and flags as GenerateDatasetRandom / GenerateDatasetEven
+SoaDataset GenerateSoaDatasetRandom()
+{
+    std::minstd_rand rne;
+    std::uniform_real_distribution vDist{ 0., 2. * std::numbers::pi };
+    std::bernoulli_distribution hDist{ ProbabilityHeavy };
+
+    SoaDataset data(DatasetSize);
+    for (size_t i = 0; i < data.Size(); i++) {
+        data.Values()[i] = vDist(rne);
+        data.SetHeavy(i, hDist(rne));
+    }
+    return data;
+}
+
+SoaDataset GenerateSoaDatasetEven()
+{
+    std::minstd_rand rne;
+    std::uniform_real_distribution vDist{ 0., 2. * std::numbers::pi };
+
+    SoaDataset data(DatasetSize);
+    double acc = 0.;
+    for (size_t i = 0; i < data.Size(); i++) {
+        data.Values()[i] = vDist(rne);
+        if ((acc += ProbabilityHeavy) >= 1.) {
+            acc -= 1.;
+            data.SetHeavy(i, true);
+        }
+    }
+    return data;
+}
+
+// heavy items first like GenerateDatasetStacked, but stable: each group keeps generation order
+SoaDataset GenerateSoaDatasetStacked()
+{
+    const auto even = GenerateSoaDatasetEven();
+    SoaDataset data(even.Size());
+    const auto nHeavy = even.HeavyCount();
+    size_t nextHeavy = 0;
+    size_t nextLight = nHeavy;
+    for (size_t i = 0; i < even.Size(); i++) {
+        if (even.IsHeavy(i)) {
+            data.Values()[nextHeavy++] = even.Values()[i];
+        }
+        else {
+            data.Values()[nextLight++] = even.Values()[i];
+        }
+    }
+    for (size_t i = 0; i < nHeavy; i++) {
+        data.SetHeavy(i, true);
+    }
+    return data;
+}
+
+SoaDataset GenerateSoaDataset(std::string_view kind)
+{
+    if (kind == "random") {
+        return GenerateSoaDatasetRandom();
+    }
+    if (kind == "even") {
+        return GenerateSoaDatasetEven();
+    }
+    if (kind == "stacked") {
+        return GenerateSoaDatasetStacked();
+    }
+    throw std::invalid_argument{ "unknown dataset (expected random, even or stacked)" };
+}
@@ -1,25 +1,41 @@
 #pragma once
 #include <random>
+#include <algorithm>
 #include <array>
 #include <ranges>
 #include <cmath>
 #include <numbers>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
 #include "Constants.h"
 
 struct Task
 {
     double val;
     bool heavy;
+    // one iteration of Process: the digits (always below 100'000) the next value is made from
+    static unsigned Step(double intermediate)
+    {
+        return unsigned(std::abs(std::sin(std::cos(intermediate) * std::numbers::pi) * 10'000'000.)) % 100'000;
+    }
+    size_t Iterations() const
+    {
+        return heavy ? HeavyIterations : LightIterations;
+    }
     unsigned int Process() const
     {
-        const auto iterations = heavy ? HeavyIterations : LightIterations;
+        return Iterate(Iterations());
+    }
+    // Process with an explicit iteration count
+    unsigned int Iterate(size_t iterations) const
+    {
         auto intermediate = val;
         for (size_t i = 0; i < iterations; i++)
         {
-            const auto digits = unsigned int(std::abs(std::sin(std::cos(intermediate) * std::numbers::pi) * 10'000'000.)) % 100'000;
-            intermediate = double(digits) / 10'000.;
+            intermediate = double(Step(intermediate)) / 10'000.;
         }
-        return unsigned int(std::exp(intermediate));
+        return unsigned(std::exp(intermediate));
     }
 };
 
@@ -59,4 +75,18 @@ Dataset GenerateDatasetStacked()
     auto data = GenerateDatasetEven();
     std::ranges::partition(data, std::identity{}, &Task::heavy);
     return data;
+}
+
+Dataset GenerateDataset(std::string_view kind)
+{
+    if (kind == "random") {
+        return GenerateDatasetRandom();
+    }
+    if (kind == "even") {
+        return GenerateDatasetEven();
+    }
+    if (kind == "stacked") {
+        return GenerateDatasetStacked();
+    }
+    throw std::invalid_argument{ "unknown dataset (expected random, even or stacked)" };
 }
\ No newline at end of file
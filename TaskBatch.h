@@ -0,0 +1,268 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numbers>
+#include <span>
+#include <string>
+#include <vector>
+#include "ChiliTimer.h"
+#include "SoaDataset.h"
+#include "Task.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// batched Task::Process
+// the Simd kernel runs four tasks at once in AVX2 lanes with a vectorized sin/cos (Cephes
+// polynomials with Cody-Waite reduction, ~1 ulp). Lanes are refilled from the batch as their
+// task's iteration count runs out and masked off once the batch is exhausted, so a mix of
+// light and heavy tasks keeps all four lanes busy until the tail.
+// Each iteration truncates to a multiple of 1e-4, which absorbs the last-bit differences to the
+// C runtime's sin/cos unless one lands right on a truncation boundary, so results normally match
+// Task::Process exactly; --verify-batch counts the ones that don't. The Scalar kernel is exact
+// by construction and is what Simd falls back to when not compiled with AVX2 (/arch:AVX2, -mavx2).
+// exp runs once per task, so it stays scalar.
+
+enum class BatchKernel
+{
+    Scalar,
+    Simd,
+};
+
+constexpr bool SimdBatchAvailable()
+{
+#if defined(__AVX2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if defined(__AVX2__)
+namespace simd
+{
+    inline __m256d Poly(__m256d x, const std::array<double, 6>& c)
+    {
+        auto r = _mm256_set1_pd(c[0]);
+        for (size_t i = 1; i < c.size(); i++) {
+            r = _mm256_add_pd(_mm256_mul_pd(r, x), _mm256_set1_pd(c[i]));
+        }
+        return r;
+    }
+
+    // shared by sin and cos: reduces |x| to z in [-pi/4, pi/4] and returns octant j (even, 0..6)
+    inline __m256d Reduce(__m256d ax, __m128i& j)
+    {
+        constexpr double dp1 = 7.85398125648498535156E-1;
+        constexpr double dp2 = 3.77489470793079817668E-8;
+        constexpr double dp3 = 2.69515142907905952645E-15;
+        const auto q = _mm256_floor_pd(_mm256_mul_pd(ax, _mm256_set1_pd(4. / std::numbers::pi)));
+        // round odd octants up to the next even one
+        j = _mm256_cvttpd_epi32(q);
+        j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+        const auto y = _mm256_cvtepi32_pd(j);
+        j = _mm_and_si128(j, _mm_set1_epi32(7));
+        auto z = _mm256_sub_pd(ax, _mm256_mul_pd(y, _mm256_set1_pd(dp1)));
+        z = _mm256_sub_pd(z, _mm256_mul_pd(y, _mm256_set1_pd(dp2)));
+        return _mm256_sub_pd(z, _mm256_mul_pd(y, _mm256_set1_pd(dp3)));
+    }
+
+    inline __m256d LaneMask(__m128i mask32)
+    {
+        return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(mask32));
+    }
+
+    inline __m256d SinPoly(__m256d z, __m256d zz)
+    {
+        static constexpr std::array<double, 6> sinCoefs{
+            1.58962301576546568060E-10, -2.50507477628578072866E-8, 2.75573136213857245213E-6,
+            -1.98412698295895385996E-4, 8.33333333332211858878E-3, -1.66666666666666307295E-1,
+        };
+        return _mm256_add_pd(z, _mm256_mul_pd(_mm256_mul_pd(z, zz), Poly(zz, sinCoefs)));
+    }
+
+    inline __m256d CosPoly(__m256d zz)
+    {
+        static constexpr std::array<double, 6> cosCoefs{
+            -1.13585365213876817300E-11, 2.08757008419747316778E-9, -2.75573141792967388112E-7,
+            2.48015872888517045348E-5, -1.38888888888730564116E-3, 4.16666666666665929218E-2,
+        };
+        const auto zz2 = _mm256_mul_pd(zz, zz);
+        return _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(1.), _mm256_mul_pd(zz, _mm256_set1_pd(.5))),
+            _mm256_mul_pd(zz2, Poly(zz, cosCoefs)));
+    }
+
+    inline __m256d Sin(__m256d x)
+    {
+        const auto signBit = _mm256_set1_pd(-0.);
+        auto sign = _mm256_and_pd(x, signBit);
+        __m128i j;
+        const auto z = Reduce(_mm256_andnot_pd(signBit, x), j);
+        const auto zz = _mm256_mul_pd(z, z);
+        // octants 4..7 flip the sign, octant 2 (mod 4) uses the cosine polynomial
+        sign = _mm256_xor_pd(sign, _mm256_and_pd(signBit, LaneMask(_mm_cmpgt_epi32(j, _mm_set1_epi32(3)))));
+        const auto useCos = LaneMask(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(3)), _mm_set1_epi32(2)));
+        const auto r = _mm256_blendv_pd(SinPoly(z, zz), CosPoly(zz), useCos);
+        return _mm256_xor_pd(r, sign);
+    }
+
+    inline __m256d Cos(__m256d x)
+    {
+        const auto signBit = _mm256_set1_pd(-0.);
+        __m128i j;
+        const auto z = Reduce(_mm256_andnot_pd(signBit, x), j);
+        const auto zz = _mm256_mul_pd(z, z);
+        // Cephes: if j > 3 { j -= 4; flip } then if j > 1 flip
+        const auto upper = _mm_cmpgt_epi32(j, _mm_set1_epi32(3));
+        const auto j4 = _mm_and_si128(j, _mm_set1_epi32(3));
+        const auto flip = _mm_xor_si128(upper, _mm_cmpgt_epi32(j4, _mm_set1_epi32(1)));
+        const auto useSin = LaneMask(_mm_cmpeq_epi32(j4, _mm_set1_epi32(2)));
+        const auto r = _mm256_blendv_pd(CosPoly(zz), SinPoly(z, zz), useSin);
+        return _mm256_xor_pd(r, _mm256_and_pd(signBit, LaneMask(flip)));
+    }
+
+    // one Task::Process iteration on four lanes
+    inline __m256d Step(__m256d x)
+    {
+        const auto s = Sin(_mm256_mul_pd(Cos(x), _mm256_set1_pd(std::numbers::pi)));
+        const auto scaled = _mm256_mul_pd(_mm256_andnot_pd(_mm256_set1_pd(-0.), s), _mm256_set1_pd(10'000'000.));
+        // integer part mod 100'000, done in doubles (everything here is an exact integer below 2^53)
+        const auto t = _mm256_floor_pd(scaled);
+        const auto q = _mm256_floor_pd(_mm256_div_pd(t, _mm256_set1_pd(100'000.)));
+        const auto digits = _mm256_sub_pd(t, _mm256_mul_pd(q, _mm256_set1_pd(100'000.)));
+        return _mm256_div_pd(digits, _mm256_set1_pd(10'000.));
+    }
+
+    // four tasks in flight; Add queues one task per free lane and runs the lanes whenever they
+    // are all busy, until the one with the fewest iterations left is done and frees its lane
+    class Lanes
+    {
+    public:
+        explicit Lanes(std::span<unsigned> out) : out_{ out }
+        {
+            remaining_.fill(retired_);
+        }
+        // out[index] = the result of iterations steps from val
+        void Add(size_t index, double val, size_t iterations)
+        {
+            if (iterations == 0) {
+                out_[index] = unsigned(std::exp(val));
+                return;
+            }
+            auto free = std::ranges::find(remaining_, retired_);
+            while (free == remaining_.end()) {
+                Advance_();
+                free = std::ranges::find(remaining_, retired_);
+            }
+            const auto lane = size_t(free - remaining_.begin());
+            x_[lane] = val;
+            remaining_[lane] = iterations;
+            owner_[lane] = index;
+        }
+        // runs the tasks still in the lanes to the end
+        void Finish()
+        {
+            while (std::ranges::min(remaining_) != retired_) {
+                Advance_();
+            }
+        }
+    private:
+        static constexpr size_t nLanes_ = 4;
+        static constexpr auto retired_ = std::numeric_limits<size_t>::max();
+        void Advance_()
+        {
+            const auto steps = std::ranges::min(remaining_);
+            // free lanes keep iterating on stale values; their results are never read
+            auto v = _mm256_load_pd(x_.data());
+            for (size_t i = 0; i < steps; i++) {
+                v = Step(v);
+            }
+            _mm256_store_pd(x_.data(), v);
+            for (size_t lane = 0; lane < nLanes_; lane++) {
+                if (remaining_[lane] == retired_) {
+                    continue;
+                }
+                if ((remaining_[lane] -= steps) == 0) {
+                    out_[owner_[lane]] = unsigned(std::exp(x_[lane]));
+                    remaining_[lane] = retired_;
+                }
+            }
+        }
+        alignas(32) std::array<double, nLanes_> x_{};
+        std::array<size_t, nLanes_> remaining_;
+        std::array<size_t, nLanes_> owner_{};
+        std::span<unsigned> out_;
+    };
+}
+#endif
+
+// out[i] = tasks[i].Process(), several tasks at a time when the Simd kernel is available
+void ProcessBatch(std::span<const Task> tasks, std::span<unsigned> out, BatchKernel kernel = BatchKernel::Simd)
+{
+#if defined(__AVX2__)
+    if (kernel == BatchKernel::Simd) {
+        simd::Lanes lanes{ out };
+        for (size_t i = 0; i < tasks.size(); i++) {
+            lanes.Add(i, tasks[i].val, tasks[i].Iterations());
+        }
+        lanes.Finish();
+        return;
+    }
+#endif
+    std::ranges::transform(tasks, out.begin(), &Task::Process);
+}
+
+// out[i] = tasks[i].Process() for an SoA dataset
+void ProcessBatch(const SoaDataset& tasks, std::span<unsigned> out, BatchKernel kernel = BatchKernel::Simd)
+{
+#if defined(__AVX2__)
+    if (kernel == BatchKernel::Simd) {
+        // values stream with unit stride, one flag lookup per run of equally heavy tasks
+        simd::Lanes lanes{ out };
+        size_t i = 0;
+        tasks.ForEachRun([&](std::span<const double> values, bool heavy) {
+            const auto iterations = heavy ? HeavyIterations : LightIterations;
+            for (const auto val : values) {
+                lanes.Add(i++, val, iterations);
+            }
+        });
+        lanes.Finish();
+        return;
+    }
+#endif
+    std::ranges::transform(tasks.Tasks(), out.begin(), &Task::Process);
+}
+
+// times both kernels on both layouts of the configured dataset and counts results that are
+// not bit-identical to Task::Process (--verify-batch)
+void RunBatchVerify()
+{
+    const auto tasks = GenerateDataset(DatasetKind);
+    const SoaDataset soaTasks{ tasks };
+    std::vector<unsigned> reference(tasks.size());
+    ChiliTimer timer;
+    std::ranges::transform(tasks, reference.begin(), &Task::Process);
+    const auto referenceTime = timer.Mark();
+    std::cout << "tasks: " << tasks.size() << ", simd kernel " << (SimdBatchAvailable() ? "available" : "not compiled in (scalar fallback)") << std::endl;
+    std::cout << std::setw(10) << "kernel" << " | " << std::setw(8) << "seconds" << " | mismatches" << std::endl;
+    std::cout << std::setw(10) << "Process" << " | " << std::fixed << std::setprecision(3) << std::setw(8) << referenceTime << " | -" << std::endl;
+    const auto measure = [&](const std::string& name, auto&& run) {
+        std::vector<unsigned> results(tasks.size());
+        timer.Mark();
+        run(results);
+        const auto time = timer.Mark();
+        size_t mismatches = 0;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            mismatches += results[i] != reference[i];
+        }
+        std::cout << std::setw(10) << name << " | " << std::setw(8) << time << " | " << mismatches << std::endl;
+    };
+    for (const auto& [name, kernel] : { std::pair{ "scalar", BatchKernel::Scalar }, std::pair{ "simd", BatchKernel::Simd } }) {
+        measure(name, [&](std::span<unsigned> out) { ProcessBatch(tasks, out, kernel); });
+        measure(std::string(name) + " soa", [&](std::span<unsigned> out) { ProcessBatch(soaTasks, out, kernel); });
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "Blocking.h"
+#include "Future.h"
+
+namespace tk
+{
+    namespace detail
+    {
+        // in-flight counter shared by the members of a group; only the submissions that
+        // take it off zero and the completions that bring it back touch the mutex
+        class GroupState
+        {
+        public:
+            void Add(size_t n)
+            {
+                if (pending_.fetch_add(n, std::memory_order_relaxed) == 0) {
+                    std::lock_guard lk{ mtx_ };
+                    done_ = pending_.load(std::memory_order_relaxed) == 0;
+                }
+            }
+            void Done()
+            {
+                if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    // done_ is recomputed under the lock so a racing Add can't be overwritten,
+                    // and nothing touches this state after the unlock (the waiter may free it)
+                    std::lock_guard lk{ mtx_ };
+                    done_ = pending_.load(std::memory_order_relaxed) == 0;
+                    if (done_) {
+                        doneCv_.notify_all();
+                    }
+                }
+            }
+            // keeps the first exception thrown by a member
+            void Fail(std::exception_ptr exception)
+            {
+                std::lock_guard lk{ mtx_ };
+                if (!exception_) {
+                    exception_ = std::move(exception);
+                }
+            }
+            void Wait()
+            {
+                std::unique_lock lk{ mtx_ };
+                if (!done_) {
+                    BlockingRegion blocking;
+                    doneCv_.wait(lk, [this] { return done_; });
+                }
+            }
+            bool IsDone()
+            {
+                std::lock_guard lk{ mtx_ };
+                return done_;
+            }
+            std::exception_ptr TakeException()
+            {
+                std::lock_guard lk{ mtx_ };
+                return std::exchange(exception_, nullptr);
+            }
+            // resources (such as a shared callable) that must outlive every member
+            void Keep(std::shared_ptr<void> resource)
+            {
+                std::lock_guard lk{ mtx_ };
+                resources_.push_back(std::move(resource));
+            }
+        private:
+            std::atomic<size_t> pending_ = 0;
+            std::mutex mtx_;
+            std::condition_variable doneCv_;
+            bool done_ = true;
+            std::exception_ptr exception_;
+            std::vector<std::shared_ptr<void>> resources_;
+        };
+
+        // one member's stake in a group, counted from construction; Run completes it, and
+        // dropping it unrun (its task was cancelled, or its pool shut down) fails it with
+        // AbandonError, so the group never waits on work that is gone
+        class GroupMember
+        {
+        public:
+            explicit GroupMember(GroupState& state) : state_{ &state }
+            {
+                state_->Add(1);
+            }
+            GroupMember(GroupMember&& other) noexcept : state_{ std::exchange(other.state_, nullptr) } {}
+            GroupMember& operator=(GroupMember&&) = delete;
+            ~GroupMember()
+            {
+                if (state_) {
+                    state_->Fail(AbandonError());
+                    state_->Done();
+                }
+            }
+            template<typename F>
+            void Run(F&& f)
+            {
+                try {
+                    f();
+                }
+                catch (...) {
+                    state_->Fail(std::current_exception());
+                }
+                std::exchange(state_, nullptr)->Done();
+            }
+        private:
+            GroupState* state_;
+        };
+    }
+
+    // one handle for a batch of tasks instead of one future per task
+    // members refer to the group's state directly, so destroying the handle waits for them
+    // a member may add further members (ThreadPool::RunIn from inside a member): they are
+    // counted before their parent finishes, so Wait also covers every nested spawn
+    class TaskGroup
+    {
+        friend class ThreadPool;
+    public:
+        TaskGroup() : state_{ std::make_unique<detail::GroupState>() } {}
+        TaskGroup(TaskGroup&&) noexcept = default;
+        TaskGroup& operator=(TaskGroup&& other) noexcept
+        {
+            if (this != &other) {
+                Drain_();
+                state_ = std::move(other.state_);
+            }
+            return *this;
+        }
+        ~TaskGroup()
+        {
+            Drain_();
+        }
+        // blocks until every member has finished, then rethrows the first member exception
+        void Wait()
+        {
+            state_->Wait();
+            if (auto exception = state_->TakeException()) {
+                std::rethrow_exception(exception);
+            }
+        }
+        bool IsDone() const
+        {
+            return state_->IsDone();
+        }
+        // makes the completion of future a member of the group (its exception counts as the
+        // member's); the future is consumed and nothing waits on it
+        template<typename T>
+        void Track(Future<T> future)
+        {
+            auto* state = state_.get();
+            state->Add(1);
+            auto* antecedent = future.state_.get();
+            antecedent->OnReady([state, antecedent = std::move(future.state_)] {
+                if (antecedent->GetException()) {
+                    state->Fail(antecedent->GetException());
+                }
+                state->Done();
+            });
+        }
+    private:
+        void Drain_() noexcept
+        {
+            if (state_) {
+                state_->Wait();
+            }
+        }
+        std::unique_ptr<detail::GroupState> state_;
+    };
+}
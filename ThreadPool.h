@@ -0,0 +1,1018 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "Affinity.h"
+#include "Blocking.h"
+#include "Cancel.h"
+#include "Future.h"
+#include "Histogram.h"
+#include "InlineTask.h"
+#include "MpmcQueue.h"
+#include "RingBuffer.h"
+#include "TaskGroup.h"
+#include "Trace.h"
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace tk
+{
+    enum class QueueMode
+    {
+        // one deque shared by all workers behind a single mutex
+        Shared,
+        // per-worker deques; workers pop their own (LIFO) and steal from others (FIFO)
+        WorkStealing,
+        // bounded lock-free MPMC ring, spilling to the shared deque only when the ring is full
+        LockFree,
+        // one shared heap behind a single mutex, most expensive CostHint first (longest
+        // processing time first); equal costs run in submission order
+        Priority,
+    };
+
+    // expected relative cost of a task; only the Priority queue mode looks at it
+    struct CostHint
+    {
+        double cost = 0.;
+    };
+
+    // latest time a task may start; one still queued by then is dropped at dequeue without
+    // running, and its future fails with DeadlineExceeded
+    struct Deadline
+    {
+        std::chrono::steady_clock::time_point at;
+
+        static Deadline In(std::chrono::steady_clock::duration budget)
+        {
+            return { std::chrono::steady_clock::now() + budget };
+        }
+    };
+
+    // worker count bounds; a pool with maxWorkers > minWorkers is elastic: it starts with
+    // minWorkers, adds workers while tasks are queued, no worker is idle and either fewer than
+    // minWorkers are runnable (the rest being inside a BlockingRegion) or no task has finished
+    // for stallTimeout, and retires workers that found no work for idleTimeout
+    struct PoolSize
+    {
+        size_t minWorkers;
+        size_t maxWorkers;
+        std::chrono::milliseconds idleTimeout{ 500 };
+        std::chrono::milliseconds stallTimeout{ 250 };
+        std::chrono::microseconds checkInterval{ 1000 };
+
+        static PoolSize Fixed(size_t numWorkers)
+        {
+            return { .minWorkers = numWorkers, .maxWorkers = numWorkers };
+        }
+    };
+
+    // what a worker does when it runs out of work: check for new work spins times with a cpu
+    // pause in between, then yields times with a yield in between, and only then parks on the
+    // condition variable; while any worker is spinning, submitters don't notify at all
+    // the default parks straight away
+    struct IdlePolicy
+    {
+        uint32_t spins = 0;
+        uint32_t yields = 0;
+    };
+
+    namespace detail
+    {
+        inline void CpuRelax()
+        {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#elif defined(__aarch64__)
+            asm volatile("yield");
+#endif
+        }
+    }
+
+    inline QueueMode ParseQueueMode(std::string_view name)
+    {
+        if (name == "shared") {
+            return QueueMode::Shared;
+        }
+        if (name == "stealing") {
+            return QueueMode::WorkStealing;
+        }
+        if (name == "lockfree") {
+            return QueueMode::LockFree;
+        }
+        if (name == "lpt") {
+            return QueueMode::Priority;
+        }
+        throw std::invalid_argument{ "unknown queue mode (expected shared, stealing, lockfree or lpt)" };
+    }
+
+    class ThreadPool
+    {
+        using Clock = std::chrono::steady_clock;
+        // queued work, stamped on creation so the worker that picks it up can tell how long it waited
+        struct Task
+        {
+            Task() = default;
+            template<typename F>
+                requires (!std::same_as<std::decay_t<F>, Task>)
+            Task(F&& function) : fn{ std::forward<F>(function) }, enqueued{ Clock::now() } {}
+            explicit operator bool() const
+            {
+                return bool(fn);
+            }
+            InlineTask fn;
+            Clock::time_point enqueued;
+        };
+    public:
+        struct WorkerStats
+        {
+            size_t tasks;
+            // time spent running tasks, and between tasks (from thread start up to the last
+            // dequeue) looking for or waiting on work
+            double busySeconds;
+            double idleSeconds;
+        };
+        struct Stats
+        {
+            // enqueue to dequeue and dequeue to completion, in nanoseconds, over all workers
+            HistogramSnapshot queueWait;
+            HistogramSnapshot run;
+            // one entry per worker slot ever started, retired ones included
+            std::vector<WorkerStats> workers;
+            size_t liveWorkers;
+            size_t peakWorkers;
+        };
+
+        // name labels the pool's workers in traces
+        ThreadPool(size_t numWorkers, QueueMode mode = QueueMode::Shared, std::string name = "pool")
+            : ThreadPool(PoolSize::Fixed(numWorkers), mode, std::move(name)) {}
+        ThreadPool(PoolSize size, QueueMode mode = QueueMode::Shared, std::string name = "pool")
+            :
+            mode_{ mode },
+            name_{ std::move(name) },
+            size_{ ValidSize_(size) },
+            localQueues_(mode == QueueMode::WorkStealing ? size_.maxWorkers : 0),
+            ring_{ mode == QueueMode::LockFree ? ringCapacity_ : 0 },
+            workerStats_(size_.maxWorkers)
+        {
+            Grow_(size_.minWorkers);
+            if (size_.maxWorkers > size_.minWorkers) {
+                supervisor_ = std::jthread(std::bind_front(&ThreadPool::Supervise_, this));
+            }
+        }
+        template<typename F, typename...A>
+            requires (!std::same_as<std::decay_t<F>, CostHint> && !std::same_as<std::decay_t<F>, Deadline> &&
+                !std::same_as<std::decay_t<F>, std::stop_token>)
+        auto Run(F&& function, A&&...args)
+        {
+            return Run(CostHint{}, std::forward<F>(function), std::forward<A>(args)...);
+        }
+        template<typename F, typename...A>
+        auto Run(CostHint hint, F&& function, A&&...args)
+        {
+            using ReturnType = std::invoke_result_t<F, A...>;
+            Promise<ReturnType> promise;
+            auto future = promise.GetFuture();
+            // arguments are stored decayed and passed as lvalues, as std::bind would
+            Post([promise = std::move(promise), fn = std::forward<F>(function), ...args = std::forward<A>(args)]() mutable {
+                promise.Fulfill([&]() -> ReturnType { return std::invoke(fn, args...); });
+            }, hint);
+            return future;
+        }
+        template<typename F, typename...A>
+        auto Run(Deadline deadline, F&& function, A&&...args)
+        {
+            using ReturnType = std::invoke_result_t<F, A...>;
+            Promise<ReturnType> promise;
+            auto future = promise.GetFuture();
+            Post([promise = std::move(promise), deadline = deadline.at, fn = std::forward<F>(function), ...args = std::forward<A>(args)]() mutable {
+                if (Clock::now() > deadline) {
+                    Tracer::Instant("expired");
+                    promise.SetException(std::make_exception_ptr(DeadlineExceeded{}));
+                    return;
+                }
+                promise.Fulfill([&]() -> ReturnType { return std::invoke(fn, args...); });
+            });
+            return future;
+        }
+        // a task whose token is stopped while it is queued is dropped without running (its
+        // future fails with Cancelled); one that is already running sees the stop through the
+        // token, which is passed as the first argument when function accepts it
+        template<typename F, typename...A>
+        auto Run(std::stop_token token, F&& function, A&&...args)
+        {
+            constexpr bool takesToken = std::is_invocable_v<F, std::stop_token, A...>;
+            using ReturnType = typename std::conditional_t<takesToken,
+                std::invoke_result<F, std::stop_token, A...>, std::invoke_result<F, A...>>::type;
+            Promise<ReturnType> promise;
+            auto future = promise.GetFuture();
+            Post([promise = std::move(promise), token = std::move(token), fn = std::forward<F>(function), ...args = std::forward<A>(args)]() mutable {
+                if (token.stop_requested()) {
+                    promise.SetException(std::make_exception_ptr(Cancelled{}));
+                    return;
+                }
+                promise.Fulfill([&]() -> ReturnType {
+                    if constexpr (takesToken) {
+                        return std::invoke(fn, token, args...);
+                    }
+                    else {
+                        return std::invoke(fn, args...);
+                    }
+                });
+            });
+            return future;
+        }
+        // fire-and-forget submission, no future is created
+        template<typename F>
+        void Post(F&& function, CostHint hint = {})
+        {
+            Tracer::Instant("submit", name_.c_str());
+            Task task{ std::forward<F>(function) };
+            unfinished_.fetch_add(1, std::memory_order_relaxed);
+            if (mode_ == QueueMode::WorkStealing) {
+                PushStealing_(std::move(task));
+            }
+            else if (mode_ == QueueMode::LockFree) {
+                PushLockFree_(std::move(task));
+            }
+            else {
+                {
+                    std::lock_guard lk{ taskQueueMtx_ };
+                    PushShared_(std::move(task), hint);
+                }
+                if (spinning_ == 0) {
+                    taskQueueCv_.notify_one();
+                }
+            }
+        }
+        // fn(element) for every element of range, enqueued as one batch: one lock (or one ring
+        // reservation) per batch instead of per task, and sleeping workers are woken once
+        // elements are referenced in place when the range yields lvalues, so such a range
+        // must outlive the returned group
+        template<std::ranges::input_range R, typename F>
+        TaskGroup RunBulk(R&& range, F&& function)
+        {
+            return RunBulk(std::forward<R>(range), std::forward<F>(function), NoCost_{});
+        }
+        // the same, each element's task queued with the CostHint costOf(element) returns
+        template<std::ranges::input_range R, typename F, typename C>
+        TaskGroup RunBulk(R&& range, F&& function, C&& costOf)
+        {
+            constexpr bool hinted = !std::same_as<std::decay_t<C>, NoCost_>;
+            using Fn = std::decay_t<F>;
+            TaskGroup group;
+            auto* state = group.state_.get();
+            auto fnHolder = std::make_shared<Fn>(std::forward<F>(function));
+            auto* fn = fnHolder.get();
+            state->Keep(std::move(fnHolder));
+            std::vector<Task> tasks;
+            std::vector<CostHint> hints;
+            if constexpr (std::ranges::sized_range<R>) {
+                tasks.reserve(std::ranges::size(range));
+                if constexpr (hinted) {
+                    hints.reserve(std::ranges::size(range));
+                }
+            }
+            for (auto&& element : range) {
+                if constexpr (hinted) {
+                    hints.push_back(std::invoke(costOf, element));
+                }
+                if constexpr (std::is_lvalue_reference_v<std::ranges::range_reference_t<R>>) {
+                    tasks.emplace_back([member = detail::GroupMember{ *state }, fn, element = std::addressof(element)]() mutable {
+                        member.Run([&] { std::invoke(*fn, *element); });
+                    });
+                }
+                else {
+                    tasks.emplace_back([member = detail::GroupMember{ *state }, fn, element = std::ranges::range_value_t<R>(element)]() mutable {
+                        member.Run([&] { std::invoke(*fn, element); });
+                    });
+                }
+            }
+            PostBulk_(tasks, hints);
+            return group;
+        }
+        // run function as a member of group; may be called from inside another member
+        template<typename F>
+        void RunIn(TaskGroup& group, F&& function, CostHint hint = {})
+        {
+            Post([member = detail::GroupMember{ *group.state_ }, fn = std::forward<F>(function)]() mutable { member.Run(fn); }, hint);
+        }
+        // whether some worker is out of work, i.e. whether splitting work further would pay off
+        // on one of our own workers in stealing mode that means its own deque has run dry;
+        // otherwise a worker spinning for work is as idle as a parked one
+        bool IsStarved()
+        {
+            if (mode_ == QueueMode::WorkStealing && currentWorker_ && currentWorker_->pool_ == this) {
+                auto& queue = localQueues_[currentWorker_->index_];
+                std::lock_guard lk{ queue.mtx };
+                return queue.tasks.Empty();
+            }
+            return spinning_.load(std::memory_order_relaxed) > 0 || sleeping_.load(std::memory_order_relaxed) > 0;
+        }
+        // drops every queued task without running it; their futures fail with Cancelled and
+        // their group members complete with Cancelled, while tasks already running carry on
+        // the Shared and Priority queues are swapped out under the lock in O(1), the stealing
+        // deques one per worker, and the lock-free ring is popped empty; the dropped tasks are
+        // destroyed after the locks are released
+        // returns how many tasks were dropped
+        size_t CancelPending()
+        {
+            size_t n = 0;
+            {
+                detail::AbandonScope abandon{ std::make_exception_ptr(Cancelled{}) };
+                RingBuffer<Task> dropped;
+                std::vector<Prioritized_> droppedByCost;
+                std::vector<RingBuffer<Task>> droppedLocal;
+                if (IsShared_()) {
+                    std::lock_guard lk{ taskQueueMtx_ };
+                    n = sharedSize_.load(std::memory_order_relaxed);
+                    dropped = std::exchange(tasks_, {});
+                    droppedByCost = std::exchange(byCost_, {});
+                    sharedSize_.store(0, std::memory_order_relaxed);
+                }
+                else if (mode_ == QueueMode::WorkStealing) {
+                    const auto nQueues = Slots_();
+                    droppedLocal.reserve(nQueues);
+                    for (auto& queue : std::span{ localQueues_ }.first(nQueues)) {
+                        std::lock_guard lk{ queue.mtx };
+                        n += queue.tasks.Size();
+                        droppedLocal.push_back(std::exchange(queue.tasks, {}));
+                    }
+                    pending_ -= n;
+                }
+                else {
+                    // each popped task is destroyed as the loop moves on
+                    for (; auto task = ring_.TryPop(); n++) {}
+                    {
+                        std::lock_guard lk{ taskQueueMtx_ };
+                        n += tasks_.Size();
+                        dropped = std::exchange(tasks_, {});
+                    }
+                    pending_ -= n;
+                }
+            }
+            // only now that every dropped future has failed
+            Tracer::Instant("cancel", name_.c_str(), n);
+            if (n > 0) {
+                OnFinished_(n);
+            }
+            return n;
+        }
+        // blocks until the pool is quiescent: every task submitted so far (and any task
+        // those submit in turn) has finished running, not merely left the queue
+        // prefer a TaskGroup to wait for a particular batch
+        void WaitForAllDone()
+        {
+            std::unique_lock lk{ taskQueueMtx_ };
+            if (unfinished_.load() != 0) {
+                BlockingRegion blocking;
+                allDoneCv_.wait(lk, [this] { return unfinished_.load() == 0; });
+            }
+        }
+        // always recorded: three clock reads per task plus a few uncontended stores into
+        // the running worker's own histograms
+        Stats GetStats() const
+        {
+            Stats stats;
+            const auto slots = slots_.load(std::memory_order_acquire);
+            stats.workers.reserve(slots);
+            for (auto& w : std::span{ workerStats_ }.first(slots)) {
+                stats.queueWait.Merge(w.queueWait.Snapshot());
+                stats.run.Merge(w.run.Snapshot());
+                stats.workers.push_back({
+                    .tasks = size_t(w.tasks.load(std::memory_order_relaxed)),
+                    .busySeconds = double(w.busyNs.load(std::memory_order_relaxed)) / 1e9,
+                    .idleSeconds = double(w.idleNs.load(std::memory_order_relaxed)) / 1e9,
+                });
+            }
+            stats.liveWorkers = liveWorkers_.load(std::memory_order_relaxed);
+            stats.peakWorkers = peakWorkers_.load(std::memory_order_relaxed);
+            return stats;
+        }
+        size_t WorkerCount() const
+        {
+            return liveWorkers_.load(std::memory_order_relaxed);
+        }
+        // takes effect the next time a worker runs out of work
+        void SetIdlePolicy(IdlePolicy policy)
+        {
+            spins_.store(policy.spins, std::memory_order_relaxed);
+            yields_.store(policy.yields, std::memory_order_relaxed);
+        }
+        QueueMode GetMode() const
+        {
+            return mode_;
+        }
+        const std::string& GetName() const
+        {
+            return name_;
+        }
+        // worker i is restricted to perWorker[i % perWorker.size()], including workers an
+        // elastic pool starts later; false if any worker could not be pinned (see PinThread)
+        bool SetAffinity(std::span<const CpuSet> perWorker)
+        {
+            if (perWorker.empty()) {
+                return false;
+            }
+            std::lock_guard lk{ resizeMtx_ };
+            affinity_.assign(perWorker.begin(), perWorker.end());
+            bool pinned = true;
+            for (auto& w : workers_) {
+                if (!w.retired_.load(std::memory_order_acquire)) {
+                    pinned = w.Pin(affinity_[w.index_ % affinity_.size()]) && pinned;
+                }
+            }
+            return pinned;
+        }
+        // the pool whose worker is calling, if any
+        static ThreadPool* Current()
+        {
+            return currentWorker_ ? currentWorker_->pool_ : nullptr;
+        }
+        ~ThreadPool()
+        {
+            if (supervisor_.joinable()) {
+                supervisor_.request_stop();
+                supervisor_.join();
+            }
+            for (auto& w : workers_) {
+                w.RequestStop();
+            }
+        }
+
+    private:
+        // types
+        class Worker_
+        {
+        public:
+            Worker_(ThreadPool* pool, size_t index)
+                : pool_{ pool }, index_{ index }, thread_(std::bind_front(&Worker_::RunKernel_, this)) {}
+            // restarts a retired worker in the same slot (and so with the same local queue)
+            void Restart()
+            {
+                retired_.store(false, std::memory_order_relaxed);
+                thread_ = std::jthread(std::bind_front(&Worker_::RunKernel_, this));
+            }
+            void RequestStop()
+            {
+                thread_.request_stop();
+            }
+            bool Pin(const CpuSet& cpus)
+            {
+                return PinThread(thread_.native_handle(), cpus);
+            }
+        private:
+            friend class ThreadPool;
+            // functions
+            void RunKernel_(std::stop_token st)
+            {
+                currentWorker_ = this;
+                BlockingRegion::SetThreadCounter(&pool_->blocked_);
+                Tracer::NameThread(pool_->name_.c_str(), index_);
+                auto& stats = pool_->workerStats_[index_];
+                auto lastEnd = Clock::now();
+                while (auto task = pool_->GetTask_(st, index_)) {
+                    const auto start = Clock::now();
+                    task.fn();
+                    const auto end = Clock::now();
+                    pool_->OnFinished_();
+                    stats.Record(start - task.enqueued, end - start, start - lastEnd);
+                    // tagged by the task itself (heavy, light, ...), value is the queue wait in ns
+                    Tracer::Span("task", start, end, Tracer::TakeTag(), WorkerStats_::Nanoseconds_(start - task.enqueued));
+                    lastEnd = end;
+                }
+                // GetTask_ only comes back empty-handed on stop or when this worker retired
+                // (TryRetire_ has already marked the slot free)
+                if (!st.stop_requested()) {
+                    Tracer::Instant("retire", pool_->name_.c_str());
+                }
+            }
+            // data
+            ThreadPool* pool_;
+            size_t index_;
+            std::atomic<bool> retired_ = false;
+            std::jthread thread_;
+        };
+        struct alignas(64) LocalQueue_
+        {
+            std::mutex mtx;
+            RingBuffer<Task> tasks;
+        };
+        // written only by its own worker, read by GetStats
+        struct alignas(64) WorkerStats_
+        {
+            void Record(Clock::duration wait, Clock::duration run, Clock::duration idle)
+            {
+                const auto runNs = Nanoseconds_(run);
+                queueWait.Record(Nanoseconds_(wait));
+                this->run.Record(runNs);
+                Bump_(tasks, 1);
+                Bump_(busyNs, runNs);
+                Bump_(idleNs, Nanoseconds_(idle));
+            }
+            static uint64_t Nanoseconds_(Clock::duration d)
+            {
+                return uint64_t(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(), 0));
+            }
+            static void Bump_(std::atomic<uint64_t>& counter, uint64_t by)
+            {
+                counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+            }
+            Histogram queueWait;
+            Histogram run;
+            std::atomic<uint64_t> tasks = 0;
+            std::atomic<uint64_t> busyNs = 0;
+            std::atomic<uint64_t> idleNs = 0;
+        };
+        struct Prioritized_
+        {
+            double cost;
+            uint64_t order;
+            Task task;
+        };
+        // RunBulk without per-element hints
+        struct NoCost_ {};
+        // functions
+        Task GetTask_(std::stop_token& st, size_t workerIndex)
+        {
+            if (mode_ == QueueMode::WorkStealing) {
+                return GetTaskStealing_(st, workerIndex);
+            }
+            if (mode_ == QueueMode::LockFree) {
+                return GetTaskLockFree_(st);
+            }
+            Task task;
+            std::unique_lock lk{ taskQueueMtx_ };
+            while (SharedEmpty_() && !st.stop_requested()) {
+                if (spins_.load(std::memory_order_relaxed) || yields_.load(std::memory_order_relaxed)) {
+                    lk.unlock();
+                    const bool found = Spin_();
+                    lk.lock();
+                    if (found) {
+                        continue;
+                    }
+                }
+                if (!Sleep_(lk, st, [this] {return !SharedEmpty_(); })) {
+                    return task;
+                }
+            }
+            if (!st.stop_requested()) {
+                task = PopShared_();
+            }
+            return task;
+        }
+        // the Shared and Priority modes: one queue under taskQueueMtx_, which must be held
+        bool IsShared_() const
+        {
+            return mode_ == QueueMode::Shared || mode_ == QueueMode::Priority;
+        }
+        bool SharedEmpty_() const
+        {
+            return mode_ == QueueMode::Priority ? byCost_.empty() : tasks_.Empty();
+        }
+        void PushShared_(Task task, CostHint hint)
+        {
+            if (mode_ == QueueMode::Priority) {
+                byCost_.push_back({ hint.cost, submitted_++, std::move(task) });
+                std::ranges::push_heap(byCost_, RunsBefore_);
+            }
+            else {
+                tasks_.PushBack(std::move(task));
+            }
+            sharedSize_.store(sharedSize_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+        Task PopShared_()
+        {
+            sharedSize_.store(sharedSize_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            if (mode_ == QueueMode::Priority) {
+                std::ranges::pop_heap(byCost_, RunsBefore_);
+                auto task = std::move(byCost_.back().task);
+                byCost_.pop_back();
+                return task;
+            }
+            return tasks_.PopFront();
+        }
+        // heap order: the top is the most expensive entry, the oldest among equals
+        static bool RunsBefore_(const Prioritized_& a, const Prioritized_& b)
+        {
+            return a.cost < b.cost || (a.cost == b.cost && a.order > b.order);
+        }
+        void PushStealing_(Task task)
+        {
+            // submissions from one of our own workers stay local, others are spread round-robin
+            const bool fromOwnWorker = currentWorker_ && currentWorker_->pool_ == this;
+            auto& queue = localQueues_[fromOwnWorker ?
+                currentWorker_->index_ : nextQueue_.fetch_add(1, std::memory_order_relaxed) % Slots_()];
+            // count before publishing so pending_ never underflows when a thief is quicker than us
+            pending_++;
+            {
+                std::lock_guard lk{ queue.mtx };
+                queue.tasks.PushBack(std::move(task));
+            }
+            Wake_();
+        }
+        void PushLockFree_(Task task)
+        {
+            pending_++;
+            if (!ring_.TryPush(std::move(task))) {
+                std::lock_guard lk{ taskQueueMtx_ };
+                tasks_.PushBack(std::move(task));
+            }
+            Wake_();
+        }
+        // hints is either empty or holds one CostHint per task
+        void PostBulk_(std::span<Task> tasks, std::span<const CostHint> hints = {})
+        {
+            const auto n = tasks.size();
+            if (n == 0) {
+                return;
+            }
+            Tracer::Instant("submit bulk", name_.c_str(), n);
+            unfinished_.fetch_add(n, std::memory_order_relaxed);
+            if (IsShared_()) {
+                {
+                    std::lock_guard lk{ taskQueueMtx_ };
+                    for (size_t i = 0; i < n; i++) {
+                        PushShared_(std::move(tasks[i]), hints.empty() ? CostHint{} : hints[i]);
+                    }
+                }
+                if (const auto spinners = spinning_.load(); n > spinners) {
+                    NotifyN_(n - spinners);
+                }
+                return;
+            }
+            pending_ += n;
+            if (mode_ == QueueMode::WorkStealing) {
+                if (currentWorker_ && currentWorker_->pool_ == this) {
+                    // keep the batch local, idle workers will steal from it
+                    auto& queue = localQueues_[currentWorker_->index_];
+                    std::lock_guard lk{ queue.mtx };
+                    for (auto& task : tasks) {
+                        queue.tasks.PushBack(std::move(task));
+                    }
+                }
+                else {
+                    // one contiguous slice per worker deque
+                    const auto nQueues = Slots_();
+                    const auto first = nextQueue_.fetch_add(1, std::memory_order_relaxed);
+                    for (size_t q = 0; q < nQueues; q++) {
+                        auto& queue = localQueues_[(first + q) % nQueues];
+                        std::lock_guard lk{ queue.mtx };
+                        for (size_t i = n * q / nQueues; i < n * (q + 1) / nQueues; i++) {
+                            queue.tasks.PushBack(std::move(tasks[i]));
+                        }
+                    }
+                }
+            }
+            else {
+                // reserve ring cells a chunk at a time, whatever doesn't fit spills to the overflow deque
+                constexpr size_t chunk = ringCapacity_ / 4;
+                while (!tasks.empty()) {
+                    const auto part = tasks.first(std::min(chunk, tasks.size()));
+                    if (!ring_.TryPushBulk(part)) {
+                        break;
+                    }
+                    tasks = tasks.subspan(part.size());
+                }
+                if (!tasks.empty()) {
+                    std::lock_guard lk{ taskQueueMtx_ };
+                    for (auto& task : tasks) {
+                        tasks_.PushBack(std::move(task));
+                    }
+                }
+            }
+            Wake_(n);
+        }
+        // pairs with the sleeping_/pending_ check in Park_ (both seq_cst), so the
+        // shared mutex is only touched when somebody might actually be parked
+        // spinning workers pick up new tasks by themselves and need no notification; one that
+        // stops spinning re-checks for work under the mutex before it parks
+        void Wake_(size_t n = 1)
+        {
+            const auto spinners = spinning_.load();
+            if (n > spinners && sleeping_ > 0) {
+                { std::lock_guard lk{ taskQueueMtx_ }; }
+                NotifyN_(n - spinners);
+            }
+        }
+        void NotifyN_(size_t n)
+        {
+            if (n >= liveWorkers_.load(std::memory_order_relaxed)) {
+                taskQueueCv_.notify_all();
+            }
+            else {
+                for (size_t i = 0; i < n; i++) {
+                    taskQueueCv_.notify_one();
+                }
+            }
+        }
+        // the spin and yield phases of the idle policy; true if work showed up meanwhile
+        // at most half the workers (but at least one) spin at a time
+        bool Spin_()
+        {
+            const auto spins = spins_.load(std::memory_order_relaxed);
+            const auto yields = yields_.load(std::memory_order_relaxed);
+            const auto maxSpinners = std::max<size_t>(liveWorkers_.load(std::memory_order_relaxed) / 2, 1);
+            if (spins == 0 && yields == 0) {
+                return false;
+            }
+            if (spinning_.fetch_add(1) >= maxSpinners) {
+                spinning_--;
+                return false;
+            }
+            const auto backlog = [this] {
+                return IsShared_() ? sharedSize_.load(std::memory_order_relaxed) : pending_.load(std::memory_order_relaxed);
+            };
+            const auto hasWork = [&] {
+                return backlog() > 0;
+            };
+            bool found = false;
+            for (uint32_t i = 0; i < spins && !(found = hasWork()); i++) {
+                detail::CpuRelax();
+            }
+            for (uint32_t i = 0; i < yields && !found && !(found = hasWork()); i++) {
+                std::this_thread::yield();
+            }
+            // submitters skipped notifying while we spun, however many tasks arrived, so a spinner
+            // that found work wakes one parked worker for every queued task beyond the one it is
+            // about to take (Wake_ discounts the workers still spinning)
+            spinning_.fetch_sub(1);
+            if (found) {
+                if (const auto queued = backlog(); queued > 1) {
+                    Wake_(queued - 1);
+                }
+            }
+            return found;
+        }
+        // false when the worker should retire
+        bool Park_(std::stop_token& st)
+        {
+            std::unique_lock lk{ taskQueueMtx_ };
+            return Sleep_(lk, st, [this] {return pending_ > 0; });
+        }
+        // waits on taskQueueCv_ until pred holds or stop is requested; in an elastic pool a
+        // worker that waited idleTimeout for nothing retires (false) if the pool is above its minimum
+        template<typename P>
+        bool Sleep_(std::unique_lock<std::mutex>& lk, std::stop_token& st, P pred)
+        {
+            Tracer::Scope park{ "park" };
+            sleeping_++;
+            bool woken = true;
+            if (IsElastic_()) {
+                woken = taskQueueCv_.wait_for(lk, st, size_.idleTimeout, pred);
+            }
+            else {
+                taskQueueCv_.wait(lk, st, pred);
+            }
+            sleeping_--;
+            return woken || st.stop_requested() || !TryRetire_();
+        }
+        bool IsElastic_() const
+        {
+            return size_.maxWorkers > size_.minWorkers;
+        }
+        // the slot is marked retired together with giving up the live count, under the same
+        // lock as Grow_, so Grow_ never sees room for a worker without a free slot to put it in
+        bool TryRetire_()
+        {
+            std::lock_guard lk{ resizeMtx_ };
+            if (liveWorkers_.load(std::memory_order_relaxed) <= size_.minWorkers) {
+                return false;
+            }
+            workers_[currentWorker_->index_].retired_.store(true, std::memory_order_release);
+            liveWorkers_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        // worker slots started so far; local queues beyond this have never had an owner
+        size_t Slots_() const
+        {
+            return slots_.load(std::memory_order_acquire);
+        }
+        static PoolSize ValidSize_(PoolSize size)
+        {
+            if (size.minWorkers == 0 || size.maxWorkers < size.minWorkers) {
+                throw std::invalid_argument{ "pool size needs 0 < minWorkers <= maxWorkers" };
+            }
+            return size;
+        }
+        // starts up to n workers, reusing retired slots first
+        void Grow_(size_t n)
+        {
+            std::lock_guard lk{ resizeMtx_ };
+            n = std::min(n, size_.maxWorkers - liveWorkers_.load(std::memory_order_relaxed));
+            for (auto& w : workers_) {
+                if (n == 0) {
+                    break;
+                }
+                if (w.retired_.load(std::memory_order_acquire)) {
+                    w.Restart();
+                    OnStarted_(w);
+                    n--;
+                }
+            }
+            // local queues and stats exist for maxWorkers slots only
+            for (; n > 0 && workers_.size() < size_.maxWorkers; n--) {
+                auto& w = workers_.emplace_back(this, workers_.size());
+                slots_.store(workers_.size(), std::memory_order_release);
+                OnStarted_(w);
+            }
+        }
+        void OnStarted_(Worker_& w)
+        {
+            const auto live = liveWorkers_.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (live > peakWorkers_.load(std::memory_order_relaxed)) {
+                peakWorkers_.store(live, std::memory_order_relaxed);
+            }
+            if (!affinity_.empty()) {
+                w.Pin(affinity_[w.index_ % affinity_.size()]);
+            }
+        }
+        // queued tasks not yet taken by a worker
+        size_t Backlog_()
+        {
+            if (IsShared_()) {
+                std::lock_guard lk{ taskQueueMtx_ };
+                return mode_ == QueueMode::Priority ? byCost_.size() : tasks_.Size();
+            }
+            return pending_.load();
+        }
+        size_t Completed_() const
+        {
+            size_t completed = 0;
+            for (auto& w : std::span{ workerStats_ }.first(Slots_())) {
+                completed += size_t(w.tasks.load(std::memory_order_relaxed));
+            }
+            return completed;
+        }
+        // elastic pools only: every checkInterval, decide whether to add workers
+        void Supervise_(std::stop_token st)
+        {
+            std::mutex mtx;
+            std::condition_variable_any cv;
+            std::unique_lock lk{ mtx };
+            size_t lastCompleted = 0;
+            auto lastProgress = Clock::now();
+            while (!st.stop_requested()) {
+                cv.wait_for(lk, st, size_.checkInterval, [] { return false; });
+                const auto now = Clock::now();
+                const auto completed = Completed_();
+                const auto backlog = Backlog_();
+                if (completed != lastCompleted || backlog == 0 || sleeping_.load() > 0) {
+                    lastCompleted = completed;
+                    lastProgress = now;
+                    if (backlog == 0 || sleeping_.load() > 0) {
+                        continue;
+                    }
+                }
+                // blocked workers are replaced right away, a stalled queue gets one more worker
+                // per stallTimeout (so long-running tasks oversubscribe the cpus only slowly)
+                const auto live = liveWorkers_.load(std::memory_order_relaxed);
+                const auto runnable = live - std::min(blocked_.load(std::memory_order_relaxed), live);
+                size_t add = runnable < size_.minWorkers ? size_.minWorkers - runnable : 0;
+                if (add == 0 && now - lastProgress >= size_.stallTimeout) {
+                    add = 1;
+                    lastProgress = now;
+                }
+                add = std::min(add, backlog);
+                if (add > 0 && live < size_.maxWorkers) {
+                    Tracer::Instant("grow", name_.c_str(), add);
+                    Grow_(add);
+                }
+            }
+        }
+        Task GetTaskStealing_(std::stop_token& st, size_t workerIndex)
+        {
+            while (!st.stop_requested()) {
+                if (auto task = PopLocal_(workerIndex)) {
+                    OnTaken_();
+                    return task;
+                }
+                if (auto task = Steal_(workerIndex)) {
+                    OnTaken_();
+                    return task;
+                }
+                if (Spin_()) {
+                    continue;
+                }
+                if (!Park_(st)) {
+                    return {};
+                }
+            }
+            return {};
+        }
+        Task GetTaskLockFree_(std::stop_token& st)
+        {
+            while (!st.stop_requested()) {
+                if (auto task = ring_.TryPop()) {
+                    OnTaken_();
+                    return std::move(*task);
+                }
+                if (auto task = PopOverflow_()) {
+                    OnTaken_();
+                    return task;
+                }
+                if (Spin_()) {
+                    continue;
+                }
+                if (!Park_(st)) {
+                    return {};
+                }
+            }
+            return {};
+        }
+        Task PopOverflow_()
+        {
+            std::lock_guard lk{ taskQueueMtx_ };
+            if (tasks_.Empty()) {
+                return {};
+            }
+            return tasks_.PopFront();
+        }
+        Task PopLocal_(size_t workerIndex)
+        {
+            auto& queue = localQueues_[workerIndex];
+            std::lock_guard lk{ queue.mtx };
+            if (queue.tasks.Empty()) {
+                return {};
+            }
+            return queue.tasks.PopBack();
+        }
+        Task Steal_(size_t thiefIndex)
+        {
+            const auto nQueues = Slots_();
+            for (size_t offset = 1; offset < nQueues; offset++) {
+                auto& victim = localQueues_[(thiefIndex + offset) % nQueues];
+                std::lock_guard lk{ victim.mtx };
+                if (!victim.tasks.Empty()) {
+                    Tracer::Instant("steal", nullptr, (thiefIndex + offset) % nQueues);
+                    return victim.tasks.PopFront();
+                }
+            }
+            return {};
+        }
+        void OnTaken_()
+        {
+            pending_--;
+        }
+        // the mutex round trip keeps a WaitForAllDone that has just checked the count from
+        // missing the notification
+        void OnFinished_(size_t n = 1)
+        {
+            if (unfinished_.fetch_sub(n, std::memory_order_acq_rel) == n) {
+                { std::lock_guard lk{ taskQueueMtx_ }; }
+                allDoneCv_.notify_all();
+            }
+        }
+        // data
+        static constexpr size_t ringCapacity_ = 1 << 14;
+        inline static thread_local const Worker_* currentWorker_ = nullptr;
+        QueueMode mode_;
+        std::string name_;
+        PoolSize size_;
+        std::mutex taskQueueMtx_;
+        std::condition_variable_any taskQueueCv_;
+        std::condition_variable allDoneCv_;
+        RingBuffer<Task> tasks_;
+        std::vector<Prioritized_> byCost_;
+        uint64_t submitted_ = 0;
+        std::vector<LocalQueue_> localQueues_;
+        MpmcQueue<Task> ring_;
+        std::atomic<size_t> pending_ = 0;
+        // submitted and not yet finished running, for WaitForAllDone
+        std::atomic<size_t> unfinished_ = 0;
+        std::atomic<size_t> sleeping_ = 0;
+        std::atomic<size_t> spinning_ = 0;
+        // size of the shared queue, readable without taskQueueMtx_ (written under it)
+        std::atomic<size_t> sharedSize_ = 0;
+        std::atomic<uint32_t> spins_ = 0;
+        std::atomic<uint32_t> yields_ = 0;
+        std::atomic<size_t> nextQueue_ = 0;
+        std::vector<WorkerStats_> workerStats_;
+        std::atomic<size_t> liveWorkers_ = 0;
+        std::atomic<size_t> peakWorkers_ = 0;
+        std::atomic<size_t> slots_ = 0;
+        // workers inside a BlockingRegion
+        std::atomic<size_t> blocked_ = 0;
+        // guards workers_ and affinity_ (a deque, so growing never moves a running worker)
+        std::mutex resizeMtx_;
+        std::vector<CpuSet> affinity_;
+        std::deque<Worker_> workers_;
+        std::jthread supervisor_;
+    };
+}
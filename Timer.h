@@ -0,0 +1,225 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Affinity.h"
+#include "Future.h"
+
+namespace tk
+{
+    // hierarchical timer wheel driven by one thread; callbacks run on the timer thread,
+    // so they should only hand work off (post to a pool, fulfill a promise, ...)
+    // four levels of 64 slots cover 2^24 ticks (~4.6h at 1ms), anything further out
+    // waits in an overflow list that is re-placed every time the top level wraps
+    class Timer
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+        using Callback = std::move_only_function<void()>;
+        struct Stats
+        {
+            size_t fired;
+            // how long after its deadline a callback started, in milliseconds
+            float meanLateness;
+            // upper bound of the power-of-two microsecond bucket holding the 99th percentile (capped at max)
+            float p99Lateness;
+            float maxLateness;
+        };
+
+        explicit Timer(Clock::duration tick = std::chrono::milliseconds{ 1 })
+            :
+            tick_{ tick },
+            start_{ Clock::now() },
+            thread_(std::bind_front(&Timer::RunKernel_, this))
+        {}
+        // never fires early; fires within about one tick of the deadline when not overloaded
+        void At(Clock::time_point deadline, Callback callback)
+        {
+            bool wasEmpty;
+            {
+                std::lock_guard lk{ mtx_ };
+                wasEmpty = size_ == 0;
+                if (wasEmpty) {
+                    // nothing pending, so the wheel can skip ahead without cascading
+                    now_ = std::max(now_, TicksSinceStart_(Clock::now()));
+                }
+                // the current tick has already fired, so the earliest slot left is the next one
+                Place_({ deadline, std::max(ExpiryTick_(deadline), now_ + 1), std::move(callback) });
+                size_++;
+            }
+            if (wasEmpty) {
+                cv_.notify_one();
+            }
+        }
+        template<typename R, typename P>
+        void After(std::chrono::duration<R, P> delay, Callback callback)
+        {
+            At(Clock::now() + std::chrono::duration_cast<Clock::duration>(delay), std::move(callback));
+        }
+        // future completed on the timer thread once delay has elapsed
+        template<typename R, typename P>
+        Future<void> Delay(std::chrono::duration<R, P> delay)
+        {
+            Promise<void> promise;
+            auto future = promise.GetFuture();
+            After(delay, [promise = std::move(promise)]() mutable { promise.SetValue(); });
+            return future;
+        }
+        Stats GetStats() const
+        {
+            std::lock_guard lk{ statsMtx_ };
+            Stats stats{ .fired = fired_, .meanLateness = 0.f, .p99Lateness = 0.f, .maxLateness = 0.f };
+            if (fired_ == 0) {
+                return stats;
+            }
+            stats.meanLateness = float(latenessSumUs_ / double(fired_) / 1000.);
+            stats.maxLateness = float(latenessMaxUs_) / 1000.f;
+            size_t seen = 0;
+            for (size_t i = 0; i < latenessBuckets_.size(); i++) {
+                seen += latenessBuckets_[i];
+                if (seen * 100 >= fired_ * 99) {
+                    stats.p99Lateness = std::min(float(uint64_t(1) << i) / 1000.f, stats.maxLateness);
+                    break;
+                }
+            }
+            return stats;
+        }
+        bool SetAffinity(const CpuSet& cpus)
+        {
+            return PinThread(thread_.native_handle(), cpus);
+        }
+        static Timer& Default()
+        {
+            static Timer timer;
+            return timer;
+        }
+
+    private:
+        // types
+        struct Entry_
+        {
+            Clock::time_point deadline;
+            uint64_t expiry;
+            Callback callback;
+        };
+        // functions
+        uint64_t TicksSinceStart_(Clock::time_point t) const
+        {
+            return t <= start_ ? 0 : uint64_t((t - start_) / tick_);
+        }
+        // first tick at or after the deadline
+        uint64_t ExpiryTick_(Clock::time_point deadline) const
+        {
+            if (deadline <= start_) {
+                return 0;
+            }
+            return uint64_t((deadline - start_ + tick_ - Clock::duration{ 1 }) / tick_);
+        }
+        void Place_(Entry_ entry)
+        {
+            entry.expiry = std::max(entry.expiry, now_);
+            const auto delta = entry.expiry - now_;
+            for (size_t level = 0; level < nLevels_; level++) {
+                if (delta < (uint64_t(1) << (slotBits_ * (level + 1)))) {
+                    const auto slot = (entry.expiry >> (slotBits_ * level)) & slotMask_;
+                    wheel_[level][slot].push_back(std::move(entry));
+                    return;
+                }
+            }
+            overflow_.push_back(std::move(entry));
+        }
+        void Cascade_(std::vector<Entry_>& entries)
+        {
+            auto moving = std::move(entries);
+            entries.clear();
+            for (auto& e : moving) {
+                Place_(std::move(e));
+            }
+        }
+        // advance the wheel one tick and collect everything due on it into due_
+        void Advance_()
+        {
+            now_++;
+            if ((now_ & ((uint64_t(1) << (slotBits_ * nLevels_)) - 1)) == 0) {
+                Cascade_(overflow_);
+            }
+            // top-down so entries falling out of a higher level can still cascade this tick
+            for (size_t level = nLevels_ - 1; level > 0; level--) {
+                if ((now_ & ((uint64_t(1) << (slotBits_ * level)) - 1)) == 0) {
+                    Cascade_(wheel_[level][(now_ >> (slotBits_ * level)) & slotMask_]);
+                }
+            }
+            std::swap(due_, wheel_[0][now_ & slotMask_]);
+            size_ -= due_.size();
+        }
+        void Record_(Clock::duration lateness)
+        {
+            const auto us = uint64_t(std::max<int64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(lateness).count(), 0));
+            std::lock_guard lk{ statsMtx_ };
+            fired_++;
+            latenessSumUs_ += double(us);
+            latenessMaxUs_ = std::max(latenessMaxUs_, us);
+            latenessBuckets_[std::min<size_t>(std::bit_width(us), latenessBuckets_.size() - 1)]++;
+        }
+        void RunKernel_(std::stop_token st)
+        {
+            std::unique_lock lk{ mtx_ };
+            while (!st.stop_requested()) {
+                if (size_ == 0) {
+                    cv_.wait(lk, st, [this] { return size_ > 0; });
+                    continue;
+                }
+                const auto nextTick = start_ + tick_ * (now_ + 1);
+                if (Clock::now() < nextTick) {
+                    cv_.wait_until(lk, st, nextTick, [] { return false; });
+                    continue;
+                }
+                Advance_();
+                if (due_.empty()) {
+                    continue;
+                }
+                auto due = std::move(due_);
+                due_.clear();
+                lk.unlock();
+                for (auto& e : due) {
+                    Record_(Clock::now() - e.deadline);
+                    e.callback();
+                }
+                due.clear();
+                lk.lock();
+                // hand the emptied buffer back so steady-state ticking reuses its capacity
+                if (due_.empty()) {
+                    due_ = std::move(due);
+                }
+            }
+        }
+        // data
+        static constexpr size_t slotBits_ = 6;
+        static constexpr size_t nLevels_ = 4;
+        static constexpr uint64_t slotMask_ = (uint64_t(1) << slotBits_) - 1;
+        const Clock::duration tick_;
+        const Clock::time_point start_;
+        std::mutex mtx_;
+        std::condition_variable_any cv_;
+        uint64_t now_ = 0;
+        size_t size_ = 0;
+        std::array<std::array<std::vector<Entry_>, size_t(1) << slotBits_>, nLevels_> wheel_;
+        std::vector<Entry_> overflow_;
+        std::vector<Entry_> due_;
+        mutable std::mutex statsMtx_;
+        size_t fired_ = 0;
+        double latenessSumUs_ = 0.;
+        uint64_t latenessMaxUs_ = 0;
+        std::array<size_t, 40> latenessBuckets_{};
+        std::jthread thread_;
+    };
+}
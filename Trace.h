@@ -0,0 +1,217 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace tk
+{
+    // optional timeline of pool activity, written as Chrome trace-event JSON (loads in
+    // Perfetto and chrome://tracing)
+    // every thread appends to its own chunked buffer: no locks and no shared cache lines on
+    // the recording path, and one relaxed load when tracing is off
+    // names and string arguments are stored as pointers, so they must outlive Write
+    // (string literals, or the name of a pool that is still alive)
+    class Tracer
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static void Enable()
+        {
+            Get_().enabled.store(true, std::memory_order_relaxed);
+        }
+        static bool Enabled()
+        {
+            return Get_().enabled.load(std::memory_order_relaxed);
+        }
+        // labels the calling thread as thread index of process (a pool) in the trace;
+        // unlabelled threads show up under "external"
+        static void NameThread(const char* process, size_t index)
+        {
+            threadProcess_ = process;
+            threadIndex_ = index;
+        }
+        // tags the task running on this thread; picked up when its span is recorded
+        static void Tag(const char* label)
+        {
+            threadTag_ = label;
+        }
+        static const char* TakeTag()
+        {
+            return std::exchange(threadTag_, nullptr);
+        }
+        static void Span(const char* name, Clock::time_point start, Clock::time_point end,
+            const char* label = nullptr, uint64_t value = 0)
+        {
+            if (Enabled()) {
+                Buffer_().Push({ name, label, value, Since_(start), Since_(end) - Since_(start), 'X' });
+            }
+        }
+        static void Instant(const char* name, const char* label = nullptr, uint64_t value = 0)
+        {
+            if (Enabled()) {
+                Buffer_().Push({ name, label, value, Since_(Clock::now()), 0, 'i' });
+            }
+        }
+        // records a span covering its own lifetime
+        class Scope
+        {
+        public:
+            explicit Scope(const char* name) : name_{ Enabled() ? name : nullptr }
+            {
+                if (name_) {
+                    start_ = Clock::now();
+                }
+            }
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+            ~Scope()
+            {
+                if (name_) {
+                    Span(name_, start_, Clock::now());
+                }
+            }
+        private:
+            const char* name_;
+            Clock::time_point start_;
+        };
+        // may run while other threads are still recording; their newest events may be missed
+        static bool Write(const std::string& path)
+        {
+            std::ofstream out{ path };
+            if (!out) {
+                return false;
+            }
+            auto& state = Get_();
+            std::lock_guard lk{ state.mtx };
+            std::map<std::string, size_t> pids;
+            out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            bool first = true;
+            const auto sep = [&]() -> std::ofstream& {
+                out << (first ? "" : ",\n");
+                first = false;
+                return out;
+            };
+            for (size_t tid = 0; tid < state.buffers.size(); tid++) {
+                const auto& buffer = *state.buffers[tid];
+                const auto* process = buffer.process ? buffer.process : "external";
+                const auto [it, isNew] = pids.try_emplace(process, pids.size() + 1);
+                const auto pid = it->second;
+                if (isNew) {
+                    sep() << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid
+                        << ",\"args\":{\"name\":\"" << process << "\"}}";
+                }
+                sep() << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid << ",\"tid\":" << tid
+                    << ",\"args\":{\"name\":\"" << (buffer.process ? "worker " + std::to_string(buffer.index) : "thread " + std::to_string(tid)) << "\"}}";
+                for (auto* chunk = buffer.head.get(); chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+                    const auto n = chunk->count.load(std::memory_order_acquire);
+                    for (size_t i = 0; i < n; i++) {
+                        const auto& e = chunk->events[i];
+                        sep() << "{\"ph\":\"" << e.phase << "\",\"name\":\"" << e.name << "\",\"pid\":" << pid
+                            << ",\"tid\":" << tid << ",\"ts\":" << double(e.ts) / 1000.;
+                        if (e.phase == 'X') {
+                            out << ",\"dur\":" << double(e.dur) / 1000.;
+                        }
+                        else {
+                            out << ",\"s\":\"t\"";
+                        }
+                        out << ",\"args\":{\"value\":" << e.value;
+                        if (e.label) {
+                            out << ",\"label\":\"" << e.label << '"';
+                        }
+                        out << "}}";
+                    }
+                }
+            }
+            out << "\n]}\n";
+            return bool(out);
+        }
+
+    private:
+        // types
+        struct Event_
+        {
+            const char* name;
+            const char* label;
+            uint64_t value;
+            // nanoseconds since the tracer started
+            int64_t ts;
+            int64_t dur;
+            char phase;
+        };
+        struct Chunk_
+        {
+            std::array<Event_, 1024> events;
+            std::atomic<size_t> count = 0;
+            // next is what readers follow, owned is what keeps it alive
+            std::atomic<Chunk_*> next = nullptr;
+            std::unique_ptr<Chunk_> owned;
+        };
+        // single writer (its thread), read by Write; events are published by the release
+        // store of the chunk count, chunks by the release store of next
+        struct ThreadBuffer_
+        {
+            void Push(const Event_& e)
+            {
+                auto n = tail->count.load(std::memory_order_relaxed);
+                if (n == tail->events.size()) {
+                    tail->owned = std::make_unique<Chunk_>();
+                    tail->next.store(tail->owned.get(), std::memory_order_release);
+                    tail = tail->owned.get();
+                    n = 0;
+                }
+                tail->events[n] = e;
+                tail->count.store(n + 1, std::memory_order_release);
+            }
+            const char* process = nullptr;
+            size_t index = 0;
+            std::unique_ptr<Chunk_> head = std::make_unique<Chunk_>();
+            Chunk_* tail = head.get();
+        };
+        struct Registry_
+        {
+            std::atomic<bool> enabled = false;
+            const Clock::time_point start = Clock::now();
+            std::mutex mtx;
+            std::vector<std::unique_ptr<ThreadBuffer_>> buffers;
+        };
+        // functions
+        static Registry_& Get_()
+        {
+            static Registry_ registry;
+            return registry;
+        }
+        static int64_t Since_(Clock::time_point t)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(t - Get_().start).count();
+        }
+        // registered on a thread's first event; buffers live until exit so Write can still
+        // read the threads that have finished
+        static ThreadBuffer_& Buffer_()
+        {
+            if (!threadBuffer_) {
+                auto& state = Get_();
+                std::lock_guard lk{ state.mtx };
+                auto buffer = std::make_unique<ThreadBuffer_>();
+                buffer->process = threadProcess_;
+                buffer->index = threadIndex_;
+                threadBuffer_ = buffer.get();
+                state.buffers.push_back(std::move(buffer));
+            }
+            return *threadBuffer_;
+        }
+        // data
+        inline static thread_local ThreadBuffer_* threadBuffer_ = nullptr;
+        inline static thread_local const char* threadProcess_ = nullptr;
+        inline static thread_local size_t threadIndex_ = 0;
+        inline static thread_local const char* threadTag_ = nullptr;
+    };
+}
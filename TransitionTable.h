@@ -0,0 +1,352 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <ranges>
+#include <string>
+#include <vector>
+#include "ChiliTimer.h"
+#include "Constants.h"
+#include "Parallel.h"
+#include "Task.h"
+
+// Task::Process after its first iteration only ever sees digits / 10'000. with digits below
+// 100'000, so every later iteration is a walk along a fixed 100'000-node functional graph: the
+// table holds Task::Step for every node and turns each of those iterations into one lookup.
+// Entries are Task::Step itself, so results are bit-identical to Task::Process on the same
+// C runtime; a cached table is spot-checked against Task::Step when loaded and rebuilt if the
+// runtime's sin/cos disagree with the one that wrote it.
+class TransitionTable
+{
+public:
+    static constexpr uint32_t nStates = 100'000;
+
+    // one Task::Step per state, split over pool
+    static TransitionTable Build(tk::ThreadPool& pool)
+    {
+        TransitionTable table;
+        table.next_.resize(nStates);
+        constexpr uint32_t chunk = 4'096;
+        tk::ParallelFor(pool, std::views::iota(uint32_t(0), (nStates + chunk - 1) / chunk), [&](uint32_t c) {
+            for (uint32_t d = c * chunk; d < std::min(nStates, (c + 1) * chunk); d++) {
+                table.next_[d] = Task::Step(double(d) / 10'000.);
+            }
+        });
+        return table;
+    }
+    // nothing if the file is missing, damaged or was written by a runtime that steps differently
+    static std::optional<TransitionTable> Load(const std::string& path)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            return std::nullopt;
+        }
+        FileHeader_ header;
+        TransitionTable table;
+        table.next_.resize(nStates);
+        const bool read = std::fread(&header, sizeof(header), 1, file) == 1 &&
+            std::fread(table.next_.data(), sizeof(uint32_t), nStates, file) == nStates;
+        std::fclose(file);
+        if (!read || std::memcmp(header.magic, FileHeader_{}.magic, sizeof(header.magic)) != 0 ||
+            header.version != FileHeader_{}.version || header.states != nStates || header.checksum != table.Checksum_()) {
+            return std::nullopt;
+        }
+        for (uint32_t d = 0; d < nStates; d += 997) {
+            if (table.next_[d] != Task::Step(double(d) / 10'000.)) {
+                return std::nullopt;
+            }
+        }
+        return table;
+    }
+    bool Save(const std::string& path) const
+    {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        FileHeader_ header;
+        header.checksum = Checksum_();
+        const bool written = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(next_.data(), sizeof(uint32_t), nStates, file) == nStates;
+        return std::fclose(file) == 0 && written;
+    }
+    // the cached table at path if it is usable, else a fresh one (cached at path); an empty path
+    // means no cache
+    static TransitionTable LoadOrBuild(tk::ThreadPool& pool, const std::string& path)
+    {
+        if (!path.empty()) {
+            if (auto table = Load(path)) {
+                return std::move(*table);
+            }
+        }
+        auto table = Build(pool);
+        if (!path.empty() && !table.Save(path)) {
+            std::cout << "Could not cache the transition table at " << path << std::endl;
+        }
+        return table;
+    }
+    uint32_t Next(uint32_t digits) const
+    {
+        return next_[digits];
+    }
+    // same result as t.Process()
+    unsigned Process(const Task& t) const
+    {
+        return Process(t, t.Iterations());
+    }
+    unsigned Process(const Task& t, size_t iterations) const
+    {
+        if (iterations == 0) {
+            return unsigned(std::exp(t.val));
+        }
+        auto digits = Task::Step(t.val);
+        for (size_t i = 1; i < iterations; i++) {
+            digits = next_[digits];
+        }
+        return unsigned(std::exp(double(digits) / 10'000.));
+    }
+private:
+    struct FileHeader_
+    {
+        char magic[8] = { 'm', 't', 'n', 'e', 'x', 't', 't', 't' };
+        uint32_t version = 1;
+        uint32_t states = nStates;
+        uint64_t checksum = 0;
+    };
+    uint64_t Checksum_() const
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (const auto d : next_) {
+            hash = (hash ^ d) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+    std::vector<uint32_t> next_;
+};
+
+// every walk on the table ends up going round a cycle; decomposing the graph once into tails
+// and cycles makes the state k steps ahead cheap for any k: constant time from the point a walk
+// is on its cycle (an index modulo the cycle length), and binary lifting over the tails before
+// that, whose length is bounded by the longest tail rather than by k
+// so Process costs the first Task::Step plus one jump, whatever the iteration count
+class JumpTable
+{
+public:
+    explicit JumpTable(const TransitionTable& table)
+        : tail_(TransitionTable::nStates), entry_(TransitionTable::nStates), position_(TransitionTable::nStates)
+    {
+        constexpr auto n = TransitionTable::nStates;
+        constexpr uint32_t unvisited = UINT32_MAX;
+        constexpr uint32_t done = UINT32_MAX - 1;
+        // index of each state on the walk currently being traced, or one of the markers above
+        std::vector<uint32_t> onPath(n, unvisited);
+        std::vector<uint32_t> path;
+        for (uint32_t start = 0; start < n; start++) {
+            if (onPath[start] != unvisited) {
+                continue;
+            }
+            path.clear();
+            auto d = start;
+            while (onPath[d] == unvisited) {
+                onPath[d] = uint32_t(path.size());
+                path.push_back(d);
+                d = table.Next(d);
+            }
+            // the walk closed a new cycle: from d's place on the path to the end
+            auto treeEnd = path.size();
+            if (onPath[d] != done) {
+                treeEnd = onPath[d];
+                const auto cycle = uint32_t(cycleStart_.size());
+                cycleStart_.push_back(uint32_t(cycleNodes_.size()));
+                cycleLength_.push_back(uint32_t(path.size() - treeEnd));
+                for (auto i = treeEnd; i < path.size(); i++) {
+                    const auto c = path[i];
+                    tail_[c] = 0;
+                    entry_[c] = cycle;
+                    position_[c] = uint32_t(i - treeEnd);
+                    cycleNodes_.push_back(c);
+                    onPath[c] = done;
+                }
+            }
+            // the rest hangs off a state that is already decomposed
+            for (auto i = treeEnd; i-- > 0;) {
+                const auto c = path[i];
+                const auto next = table.Next(c);
+                tail_[c] = tail_[next] + 1;
+                entry_[c] = entry_[next];
+                position_[c] = position_[next];
+                onPath[c] = done;
+                maxTail_ = std::max(maxTail_, tail_[c]);
+            }
+        }
+        // ancestor tables for walking along tails: up_[j][d] is 2^j steps after d
+        up_.emplace_back(n);
+        for (uint32_t d = 0; d < n; d++) {
+            up_[0][d] = table.Next(d);
+        }
+        while ((uint64_t(1) << up_.size()) <= maxTail_) {
+            const auto& half = up_.back();
+            std::vector<uint32_t> level(n);
+            for (uint32_t d = 0; d < n; d++) {
+                level[d] = half[half[d]];
+            }
+            up_.push_back(std::move(level));
+        }
+    }
+    // the state k steps after digits
+    uint32_t Jump(uint32_t digits, uint64_t k) const
+    {
+        const auto tail = tail_[digits];
+        if (k >= tail) {
+            // position_ of a tail state is the cycle position its walk enters at
+            const auto cycle = entry_[digits];
+            const auto length = cycleLength_[cycle];
+            return cycleNodes_[cycleStart_[cycle] + (position_[digits] + (k - tail) % length) % length];
+        }
+        for (size_t j = 0; k > 0; j++, k >>= 1) {
+            if (k & 1) {
+                digits = up_[j][digits];
+            }
+        }
+        return digits;
+    }
+    // same result as t.Process()
+    unsigned Process(const Task& t) const
+    {
+        return Process(t, t.Iterations());
+    }
+    unsigned Process(const Task& t, uint64_t iterations) const
+    {
+        if (iterations == 0) {
+            return unsigned(std::exp(t.val));
+        }
+        const auto digits = Jump(Task::Step(t.val), iterations - 1);
+        return unsigned(std::exp(double(digits) / 10'000.));
+    }
+    size_t CycleCount() const
+    {
+        return cycleStart_.size();
+    }
+    uint32_t LongestCycle() const
+    {
+        return cycleLength_.empty() ? 0 : std::ranges::max(cycleLength_);
+    }
+    uint32_t LongestTail() const
+    {
+        return maxTail_;
+    }
+private:
+    // steps until the walk from a state reaches its cycle
+    std::vector<uint32_t> tail_;
+    // the cycle a state's walk ends up on
+    std::vector<uint32_t> entry_;
+    // where on that cycle the walk enters (a cycle state's own position)
+    std::vector<uint32_t> position_;
+    // all cycles back to back, each in walking order
+    std::vector<uint32_t> cycleNodes_;
+    std::vector<uint32_t> cycleStart_;
+    std::vector<uint32_t> cycleLength_;
+    std::vector<std::vector<uint32_t>> up_;
+    uint32_t maxTail_ = 0;
+};
+
+// times building and loading the table and Task::Process against the table engine on the
+// configured dataset, counting results that are not bit-identical (--verify-table)
+void RunTableVerify()
+{
+    tk::ThreadPool pool{ std::max<size_t>(ComputeCount, 1) };
+    ChiliTimer timer;
+    const auto table = TransitionTable::Build(pool);
+    const auto buildTime = timer.Mark();
+    std::cout << "table built in " << buildTime << "s on " << std::max<size_t>(ComputeCount, 1) << " workers";
+    if (!TableCachePath.empty()) {
+        table.Save(TableCachePath);
+        timer.Mark();
+        const auto loaded = TransitionTable::Load(TableCachePath);
+        std::cout << ", " << (loaded ? "loaded from " : "could not be reloaded from ") << TableCachePath << " in " << timer.Mark() << "s";
+    }
+    std::cout << std::endl;
+
+    const auto tasks = GenerateDataset(DatasetKind);
+    std::vector<unsigned> reference(tasks.size());
+    std::vector<unsigned> results(tasks.size());
+    timer.Mark();
+    std::ranges::transform(tasks, reference.begin(), &Task::Process);
+    const auto referenceTime = timer.Mark();
+    std::ranges::transform(tasks, results.begin(), [&](const Task& t) { return table.Process(t); });
+    const auto tableTime = timer.Mark();
+    size_t mismatches = 0;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        mismatches += results[i] != reference[i];
+    }
+    std::cout << "tasks: " << tasks.size() << std::endl;
+    std::cout << std::setw(10) << "engine" << " | " << std::setw(8) << "seconds" << " | mismatches" << std::endl;
+    std::cout << std::setw(10) << "Process" << " | " << std::fixed << std::setprecision(3) << std::setw(8) << referenceTime << " | -" << std::endl;
+    std::cout << std::setw(10) << "table" << " | " << std::setw(8) << tableTime << " | " << mismatches << std::endl;
+}
+
+// per-task cost of Task::Process, the table walk and the jump table as the iteration count goes
+// from 1e3 to 1e9 (--bench-iterations); the loops are only timed while a level is expected to
+// take a few seconds at most, and every result the jump table gives is checked against the
+// slowest engine that ran
+void RunIterationBenchmark()
+{
+    using Clock = std::chrono::steady_clock;
+    tk::ThreadPool pool{ std::max<size_t>(ComputeCount, 1) };
+    ChiliTimer timer;
+    const auto table = TransitionTable::LoadOrBuild(pool, TableCachePath);
+    const auto tableTime = timer.Mark();
+    const JumpTable jumps{ table };
+    const auto jumpTime = timer.Mark();
+    std::cout << "table ready in " << tableTime << "s, jump table built in " << jumpTime << "s: " << jumps.CycleCount()
+        << " cycles, longest " << jumps.LongestCycle() << ", longest tail " << jumps.LongestTail() << std::endl;
+
+    constexpr size_t nSamples = 64;
+    constexpr double maxSeconds = 3.;
+    auto tasks = GenerateDataset(DatasetKind);
+    tasks.resize(std::min(tasks.size(), nSamples));
+    const auto perTaskUs = [&](auto&& process, std::vector<unsigned>& out) {
+        const auto start = Clock::now();
+        for (size_t i = 0; i < tasks.size(); i++) {
+            out[i] = process(tasks[i]);
+        }
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / double(tasks.size());
+    };
+    std::cout << "tasks: " << tasks.size() << ", microseconds per task" << std::endl;
+    std::cout << std::setw(10) << "iterations" << " | " << std::setw(12) << "Process" << " | " << std::setw(12) << "table walk"
+        << " | " << std::setw(10) << "jump" << " | mismatches" << std::endl;
+    double scalarUs = 0., walkUs = 0.;
+    for (uint64_t iterations = 1'000; iterations <= 1'000'000'000; iterations *= 10) {
+        std::vector<unsigned> scalar(tasks.size()), walk(tasks.size()), jump(tasks.size());
+        // the previous level's time, scaled up ten times
+        const bool runScalar = scalarUs * 10. * double(tasks.size()) < maxSeconds * 1e6;
+        const bool runWalk = walkUs * 10. * double(tasks.size()) < maxSeconds * 1e6;
+        scalarUs = runScalar ? perTaskUs([&](const Task& t) { return t.Iterate(iterations); }, scalar) : scalarUs * 10.;
+        walkUs = runWalk ? perTaskUs([&](const Task& t) { return table.Process(t, iterations); }, walk) : walkUs * 10.;
+        const auto jumpUs = perTaskUs([&](const Task& t) { return jumps.Process(t, iterations); }, jump);
+        const auto& reference = runScalar ? scalar : walk;
+        std::string mismatches = "-";
+        if (runScalar || runWalk) {
+            size_t n = 0;
+            for (size_t i = 0; i < tasks.size(); i++) {
+                n += jump[i] != reference[i];
+            }
+            mismatches = std::to_string(n) + (runScalar ? " (vs Process)" : " (vs walk)");
+        }
+        const auto cell = [](bool ran, double us) {
+            std::ostringstream ss;
+            ss << std::fixed << std::setprecision(2) << us << (ran ? "" : "*");
+            return ss.str();
+        };
+        std::cout << std::setw(10) << iterations << " | " << std::setw(12) << cell(runScalar, scalarUs) << " | "
+            << std::setw(12) << cell(runWalk, walkUs) << " | " << std::setw(10) << cell(true, jumpUs) << " | " << mismatches << std::endl;
+    }
+    std::cout << "* extrapolated from the previous row, not run" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "BenchDriver.h"
+
+// mt-bench: runs mt-next over a parameter grid, e.g.
+//   mt-bench --param compute-count=4,16 --param dataset=random,stacked --runs 10 --out base.csv
+//   mt-bench --baseline base.csv --compare new.csv --threshold 3
+
+int main(int argc, const char** argv)
+{
+    using namespace popl;
+#ifdef _WIN32
+    std::string exe = "mt-next.exe";
+#else
+    std::string exe = "./mt-next";
+#endif
+    std::string extraArgs;
+    size_t runs = 5;
+    size_t warmup = 1;
+    std::string format = "csv";
+    std::string outPath;
+    std::string baselinePath;
+    std::string comparePath;
+    double threshold = 5.;
+
+    OptionParser op;
+    const auto help = op.add<Switch>("h", "help", "");
+    op.add<Value<std::string>>("", "exe", "path to the mt-next binary")->assign_to(&exe);
+    const auto params = op.add<Value<std::string>>("", "param", "knob=v1,v2,... (repeatable; any value-taking mt-next option)");
+    op.add<Value<std::string>>("", "args", "extra arguments passed to every run")->assign_to(&extraArgs);
+    op.add<Value<size_t>>("", "runs", "measured runs per point")->assign_to(&runs);
+    op.add<Value<size_t>>("", "warmup", "discarded runs per point")->assign_to(&warmup);
+    op.add<Value<std::string>>("", "format", "csv or json")->assign_to(&format);
+    op.add<Value<std::string>>("", "out", "result file (default stdout)")->assign_to(&outPath);
+    op.add<Value<std::string>>("", "baseline", "CSV results to diff against")->assign_to(&baselinePath);
+    op.add<Value<std::string>>("", "compare", "CSV results checked against --baseline")->assign_to(&comparePath);
+    op.add<Value<double>>("", "threshold", "slowdown in percent that counts as a regression")->assign_to(&threshold);
+    try {
+        op.parse(argc, argv);
+        if (help->is_set()) {
+            std::cout << op << std::endl;
+            return 0;
+        }
+        if (!baselinePath.empty() || !comparePath.empty()) {
+            if (baselinePath.empty() || comparePath.empty()) {
+                throw std::invalid_argument{ "--baseline and --compare go together" };
+            }
+            return bench::DiffResults(baselinePath, comparePath, threshold) ? 1 : 0;
+        }
+        if (format != "csv" && format != "json") {
+            throw std::invalid_argument{ "unknown format (expected csv or json)" };
+        }
+        if (runs == 0) {
+            throw std::invalid_argument{ "--runs must be at least 1" };
+        }
+
+        std::vector<bench::Param> grid;
+        for (size_t i = 0; i < params->count(); i++) {
+            grid.push_back(bench::ParseParam(params->value(i)));
+            bench::CheckKnob(grid.back().name);
+        }
+        std::vector<bench::Result> results;
+        for (const auto& point : bench::ExpandGrid(grid)) {
+            const auto command = bench::CommandLine(exe, extraArgs, point);
+            std::cerr << command << std::flush;
+            std::vector<double> samples;
+            for (size_t i = 0; i < warmup + runs; i++) {
+                const auto seconds = bench::RunOnce(command);
+                if (!seconds) {
+                    throw std::runtime_error{ "run failed: " + command };
+                }
+                if (i >= warmup) {
+                    samples.push_back(*seconds);
+                }
+            }
+            results.push_back({ point, bench::Summarize(samples) });
+            std::cerr << "  -> " << results.back().summary.mean << "s" << std::endl;
+        }
+
+        std::ofstream file;
+        if (!outPath.empty()) {
+            file.open(outPath);
+        }
+        auto& out = outPath.empty() ? std::cout : file;
+        if (format == "csv") {
+            bench::WriteCsv(out, results);
+        }
+        else {
+            bench::WriteJson(out, results);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+    return 0;
+}
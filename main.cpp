@@ -1,164 +1,421 @@
 #include "Task.h"
-#include <condition_variable>
-#include <functional>
 #include <deque>
 #include <optional>
 #include <cassert>
 #include <ranges>
-#include <future>
 #include <vector>
 #include "ChiliTimer.h"
+#include "ChunkedDataset.h"
+#include "DatasetFile.h"
+#include "FutureBench.h"
+#include "ThreadPool.h"
+#include "Coroutine.h"
+#include "Graph.h"
+#include "GraphBench.h"
+#include "Parallel.h"
+#include "QueueBench.h"
+#include "TaskBatch.h"
+#include "TransitionTable.h"
 
 namespace rn = std::ranges;
 namespace vi = rn::views;
 
-namespace tk
-{
-    class ThreadPool
-    {
-        using Task = std::move_only_function<void()>;
-    public:
-        ThreadPool(size_t numWorkers)
-        {
-            workers_.reserve(numWorkers);
-            for (size_t i = 0; i < numWorkers; i++) {
-                workers_.emplace_back(this);
-            }
-        }
-        template<typename F, typename...A>
-        auto Run(F&& function, A&&...args)
-        {
-            using ReturnType = std::invoke_result_t<F, A...>;
-            auto pak = std::packaged_task<ReturnType()>{ std::bind(
-                std::forward<F>(function), std::forward<A>(args)...
-            ) };
-            auto future = pak.get_future();
-            Task task{ [pak = std::move(pak)]() mutable { pak(); } };
-            {
-                std::lock_guard lk{ taskQueueMtx_ };
-                tasks_.push_back(std::move(task));
-            }
-            taskQueueCv_.notify_one();
-            return future;
-        }
-        void WaitForAllDone()
-        {
-            std::unique_lock lk{ taskQueueMtx_ };
-            allDoneCv_.wait(lk, [this] {return tasks_.empty(); });
-        }
-        ~ThreadPool()
-        {
-            for (auto& w : workers_) {
-                w.RequestStop();
-            }
-        }
-
-    private:
-        // functions
-        Task GetTask_(std::stop_token& st)
-        {
-            Task task;
-            std::unique_lock lk{ taskQueueMtx_ };
-            taskQueueCv_.wait(lk, st, [this] {return !tasks_.empty(); });
-            if (!st.stop_requested()) {
-                task = std::move(tasks_.front());
-                tasks_.pop_front();
-                if (tasks_.empty()) {
-                    allDoneCv_.notify_all();
-                }
-            }
-            return task;
-        }
-        // types
-        class Worker_
-        {
-        public:
-            Worker_(ThreadPool* pool) : pool_{ pool }, thread_(std::bind_front(&Worker_::RunKernel_, this)) {}
-            void RequestStop()
-            {
-                thread_.request_stop();
-            }
-        private:
-            // functions
-            void RunKernel_(std::stop_token st)
-            {
-                while (auto task = pool_->GetTask_(st)) {
-                    task();
-                }
-            }
-            // data
-            ThreadPool* pool_;
-            std::jthread thread_;
-        };
-        // data
-        std::mutex taskQueueMtx_;
-        std::condition_variable_any taskQueueCv_;
-        std::condition_variable allDoneCv_;
-        std::deque<Task> tasks_;
-        std::vector<Worker_> workers_;
-    };
-}
-
 class Exec
 {
 public:
-    static void Init(size_t nAsync, size_t nCompute) { Get_(nAsync, nCompute); }
+    static void Init(tk::PoolSize async, tk::PoolSize compute, tk::QueueMode mode = tk::QueueMode::Shared) { Get_(async, compute, mode); }
     template<typename F, typename...A>
     static auto Async(F&& function, A&&...args) {
-        return Get_(32, 4).asyncPool_.Run(std::forward<F>(function), std::forward<A>(args)...);
+        return Get_().asyncPool_.Run(std::forward<F>(function), std::forward<A>(args)...);
     }
     template<typename F, typename...A>
     static auto Compute(F&& function, A&&...args) {
-        return Get_(32, 4).computePool_.Run(std::forward<F>(function), std::forward<A>(args)...);
+        return Get_().computePool_.Run(std::forward<F>(function), std::forward<A>(args)...);
+    }
+    // fire-and-forget members of group
+    template<typename F>
+    static void AsyncIn(tk::TaskGroup& group, F&& function) {
+        Get_().asyncPool_.RunIn(group, std::forward<F>(function));
+    }
+    template<typename F>
+    static void ComputeIn(tk::TaskGroup& group, F&& function, tk::CostHint hint = {}) {
+        Get_().computePool_.RunIn(group, std::forward<F>(function), hint);
+    }
+    // costOf(element) gives each element's CostHint
+    template<typename R, typename F, typename C>
+    static auto ComputeBulk(R&& range, F&& function, C&& costOf) {
+        return Get_().computePool_.RunBulk(std::forward<R>(range), std::forward<F>(function), std::forward<C>(costOf));
     }
+    template<typename R, typename F>
+    static void ParallelFor(R&& range, F&& function) {
+        tk::ParallelFor(ComputePool(), std::forward<R>(range), std::forward<F>(function));
+    }
+    template<typename I, typename O, typename F>
+    static void ParallelTransform(I&& in, O&& out, F&& function) {
+        tk::ParallelTransform(ComputePool(), std::forward<I>(in), std::forward<O>(out), std::forward<F>(function));
+    }
+    static tk::ThreadPool& AsyncPool() { return Get_().asyncPool_; }
+    static tk::ThreadPool& ComputePool() { return Get_().computePool_; }
+    static auto OnAsync() { return tk::ScheduleOn(AsyncPool()); }
+    static auto OnCompute(tk::CostHint hint = {}) { return tk::ScheduleOn(ComputePool(), hint); }
+    // simulated latency that holds no thread while it elapses
+    template<typename R, typename P>
+    static tk::Future<void> Delay(std::chrono::duration<R, P> delay) { return tk::Timer::Default().Delay(delay); }
 private:
-    static Exec& Get_(size_t nAsync, size_t nCompute)
+    static Exec& Get_(tk::PoolSize async = tk::PoolSize::Fixed(32), tk::PoolSize compute = tk::PoolSize::Fixed(4),
+        tk::QueueMode mode = tk::QueueMode::Shared)
     {
-        static Exec exec{ nAsync, nCompute };
+        static Exec exec{ async, compute, mode };
         return exec;
     }
-    Exec(size_t nAsync, size_t nCompute)
-        : asyncPool_{ nAsync }, computePool_{ nCompute } {}
+    Exec(tk::PoolSize async, tk::PoolSize compute, tk::QueueMode mode)
+        : asyncPool_{ async, mode, "asyncPool" }, computePool_{ compute, mode, "computePool" } {}
     tk::ThreadPool asyncPool_;
     tk::ThreadPool computePool_;
 };
 
+// compute workers get one cpu each, async workers and the timer thread share one set
+void ApplyAffinity()
+{
+    const auto topology = tk::CpuTopology::Read();
+    const auto print = [](const char* what, const tk::CpuSet& cpus) {
+        std::cout << what << " pinned to cpus";
+        for (const auto cpu : cpus) {
+            std::cout << ' ' << cpu;
+        }
+        std::cout << std::endl;
+    };
+    tk::CpuSet compute;
+    if (ComputeAffinity == "cores") {
+        compute = topology.PhysicalCores();
+    }
+    else if (ComputeAffinity != "none") {
+        compute = tk::ParseCpuList(ComputeAffinity);
+    }
+    // more workers than cpus wrap around onto the same cpus
+    compute.resize(std::min(compute.size(), ComputeCount));
+    if (!compute.empty()) {
+        std::vector<tk::CpuSet> perWorker;
+        for (const auto cpu : compute) {
+            perWorker.push_back({ cpu });
+        }
+        if (Exec::ComputePool().SetAffinity(perWorker)) {
+            print("Compute workers", compute);
+        }
+    }
+    tk::CpuSet async;
+    if (AsyncAffinity == "rest") {
+        async = topology.OtherCores(compute);
+        if (async.empty()) {
+            std::cout << "No cores left for the async threads, leaving them unpinned" << std::endl;
+        }
+    }
+    else if (AsyncAffinity != "none") {
+        async = tk::ParseCpuList(AsyncAffinity);
+    }
+    if (!async.empty() && Exec::AsyncPool().SetAffinity({ &async, 1 }) && tk::Timer::Default().SetAffinity(async)) {
+        print("Async workers and timer", async);
+    }
+}
+
+void PrintPoolStats(const char* name, const tk::ThreadPool& pool)
+{
+    const auto stats = pool.GetStats();
+    const auto us = [](uint64_t ns) { return double(ns) / 1000.; };
+    const auto print = [&](const char* what, const tk::HistogramSnapshot& h) {
+        std::cout << "  " << what << " us p50/p90/p99/max: " << us(h.Percentile(.5)) << " / " << us(h.Percentile(.9))
+            << " / " << us(h.Percentile(.99)) << " / " << us(h.Max()) << std::endl;
+    };
+    double busy = 0., idle = 0.;
+    for (auto& w : stats.workers) {
+        busy += w.busySeconds;
+        idle += w.idleSeconds;
+    }
+    std::cout << name << ": " << stats.run.Count() << " tasks, busy " << busy << "s, idle " << idle << "s, workers "
+        << stats.liveWorkers << " (peak " << stats.peakWorkers << ")" << std::endl;
+    print("queue wait", stats.queueWait);
+    print("run       ", stats.run);
+}
+
+void Finish()
+{
+    PrintPoolStats("Async pool", Exec::AsyncPool());
+    PrintPoolStats("Compute pool", Exec::ComputePool());
+    if (!TracePath.empty()) {
+        if (tk::Tracer::Write(TracePath)) {
+            std::cout << "Trace written to " << TracePath << std::endl;
+        }
+        else {
+            std::cout << "Could not write trace to " << TracePath << std::endl;
+        }
+    }
+}
+
+// counter-based datasets are streamed to disk chunk by chunk, so the file can be far larger
+// than memory; serial ones are generated in full first
+void SaveDataset()
+{
+    ChiliTimer timer;
+    std::optional<DatasetWriter> writer;
+    if (Generator == "serial") {
+        writer.emplace(SaveDatasetPath, DescribeDataset(DatasetFileHeader::Generator::Serial, DatasetKind));
+        writer->Append(GenerateDataset(DatasetKind));
+    }
+    else {
+        writer.emplace(SaveDatasetPath, DescribeDataset(DatasetFileHeader::Generator::Counter, DatasetKind));
+        DatasetStream stream{ DatasetSpec::FromCli(DatasetKind), 1 << 16 };
+        for (auto chunk = stream.Next(); !chunk.empty(); chunk = stream.Next()) {
+            writer->Append(chunk);
+        }
+    }
+    writer->Close();
+    std::cout << "Saved " << writer->Header().count << " tasks to " << SaveDatasetPath << " in " << timer.Peek() << "s" << std::endl;
+}
+
 int main(int argc, const char** argv)
 {
     using namespace std::chrono_literals;
 
     ParseCli(argc, argv);
-    Exec::Init(AsyncCount, ComputeCount);
+    // the --bench-* and --verify-* switches each run one measurement instead of the pipeline
+    const std::pair<const bool*, void (*)()> tools[] = {
+        { &BenchQueue, RunQueueBenchmark },
+        { &BenchSubmit, RunSubmitBenchmark },
+        { &BenchSchedule, RunScheduleBenchmark },
+        { &BenchWake, RunWakeBenchmark },
+        { &BenchCancel, RunCancelBenchmark },
+        { &BenchFuture, RunFutureBenchmark },
+        { &BenchGraph, RunGraphBenchmark },
+        { &BenchIterations, RunIterationBenchmark },
+        { &VerifyBatch, RunBatchVerify },
+        { &VerifyTable, RunTableVerify },
+    };
+    for (const auto& [requested, run] : tools) {
+        if (*requested) {
+            run();
+            return 0;
+        }
+    }
+    if (!TracePath.empty()) {
+        tk::Tracer::Enable();
+    }
+    // --async-max/--compute-max above the count make that pool elastic between the two
+    Exec::Init({ .minWorkers = AsyncCount, .maxWorkers = std::max(AsyncCount, AsyncMax) },
+        { .minWorkers = ComputeCount, .maxWorkers = std::max(ComputeCount, ComputeMax) },
+        tk::ParseQueueMode(QueueModeName));
+    ApplyAffinity();
+    Exec::AsyncPool().SetIdlePolicy({ .spins = IdleSpins, .yields = IdleYields });
+    Exec::ComputePool().SetIdlePolicy({ .spins = IdleSpins, .yields = IdleYields });
 
+    if (Generator != "serial" && Generator != "parallel" && Generator != "stream") {
+        throw std::invalid_argument{ "unknown generator (expected serial, parallel or stream)" };
+    }
+    if (!SaveDatasetPath.empty()) {
+        SaveDataset();
+        return 0;
+    }
+    std::optional<TransitionTable> table;
+    std::optional<JumpTable> jumps;
+    if (ProcessEngine == "table" || ProcessEngine == "jump") {
+        ChiliTimer tableTimer;
+        table = TransitionTable::LoadOrBuild(Exec::ComputePool(), TableCachePath);
+        if (ProcessEngine == "jump") {
+            jumps.emplace(*table);
+        }
+        std::cout << "Transition table ready in " << tableTimer.Peek() << "s" << std::endl;
+    }
+    else if (ProcessEngine != "scalar") {
+        throw std::invalid_argument{ "unknown engine (expected scalar, table or jump)" };
+    }
+    const bool streamed = LoadDatasetPath.empty() && Generator == "stream" &&
+        (Pipeline == "then" || Pipeline == "blocking" || Pipeline == "coro" || Pipeline == "graph");
     ChiliTimer timer;
-    auto tasks = GenerateDatasetRandom();
-    std::cout << "nTasks: " << tasks.size() << std::endl;
-    const auto computeTask = [](const Task& t) {
-        return t.Process();
+    // the pipelines read items (pointing into tasks) or slices of the mapped file
+    std::optional<MappedDataset> mapped;
+    Dataset tasks;
+    std::span<const Task> items;
+    if (!LoadDatasetPath.empty()) {
+        mapped.emplace(LoadDatasetPath);
+        if (VerifyDataset && !mapped->Verify()) {
+            throw std::runtime_error{ LoadDatasetPath + ": checksum mismatch" };
+        }
+    }
+    else if (Generator == "serial") {
+        tasks = GenerateDataset(DatasetKind);
+        items = tasks;
+    }
+    else if (!streamed) {
+        tasks = GenerateDatasetParallel(Exec::ComputePool(), DatasetSpec::FromCli(DatasetKind));
+        items = tasks;
+    }
+    const auto nTasks = streamed ? DatasetSize : mapped ? mapped->Size() : items.size();
+    std::cout << "nTasks: " << nTasks << ", " << (mapped ? "loaded" : "generated") << " in " << timer.Peek() << "s" << std::endl;
+    // fn(slice, index of its first task) over the whole dataset; a mapped file goes a slice at a
+    // time so its heavy flags are only checked as the pipeline reaches them
+    const auto forEachSlice = [&](auto&& fn) {
+        if (!mapped) {
+            fn(items, size_t(0));
+            return;
+        }
+        constexpr size_t sliceSize = 1 << 16;
+        for (size_t first = 0; first < mapped->Size(); first += sliceSize) {
+            fn(mapped->Tasks(first, std::min(sliceSize, mapped->Size() - first)), first);
+        }
     };
-    const auto asyncTask = [] {
-        std::this_thread::sleep_for(1ms * AsyncSleep);
+    // stopped once the run is over --budget, after which chains still in flight do no more work
+    std::stop_source budgetStop;
+    const auto overBudget = budgetStop.get_token();
+    const auto computeTask = [overBudget, &table, &jumps](const Task& t) {
+        if (overBudget.stop_requested()) {
+            return 0u;
+        }
+        tk::Tracer::Tag(t.heavy ? "heavy" : "light");
+        return jumps ? jumps->Process(t) : table ? table->Process(t) : t.Process();
+    };
+    // what the compute step of a chain tells the pool it will cost (only --queue-mode lpt looks)
+    const auto computeCost = [](const Task& t) {
+        return tk::CostHint{ double(t.Iterations()) };
+    };
+    const auto asyncTask = [overBudget] {
+        if (!overBudget.stop_requested()) {
+            tk::BlockingRegion blocking;
+            std::this_thread::sleep_for(1ms * AsyncSleep);
+        }
     };
 
-    timer.Mark();
-    auto futures = tasks | vi::transform([&](const Task& workItem) {
-        return Exec::Async([&] {
-            asyncTask();
-            Exec::Compute(computeTask, workItem).get();
-        });
-    }) | rn::to<std::vector>();
+    const auto coroTask = [&](const Task& workItem) -> tk::Task<unsigned int> {
+        co_await Exec::OnAsync();
+        co_await tk::SleepFor(1ms * AsyncSleep);
+        co_await Exec::OnCompute(computeCost(workItem));
+        co_return computeTask(workItem);
+    };
 
-    for (auto& f : futures) {
+    timer.Mark();
+    if (Pipeline == "bulk" || Pipeline == "parallel" || Pipeline == "batch") {
         try {
-            f.get();
+            if (Pipeline == "bulk") {
+                std::vector<tk::TaskGroup> batches;
+                forEachSlice([&](std::span<const Task> slice, size_t) {
+                    batches.push_back(Exec::ComputeBulk(slice, computeTask, computeCost));
+                });
+                for (auto& batch : batches) {
+                    batch.Wait();
+                }
+            }
+            else if (Pipeline == "batch") {
+                constexpr size_t chunk = 64;
+                std::vector<unsigned int> results(nTasks);
+                forEachSlice([&](std::span<const Task> slice, size_t offset) {
+                    Exec::ParallelFor(vi::iota(size_t(0), (slice.size() + chunk - 1) / chunk), [&](size_t c) {
+                        const auto first = c * chunk;
+                        const auto count = std::min(chunk, slice.size() - first);
+                        ProcessBatch(slice.subspan(first, count), std::span{ results }.subspan(offset + first, count));
+                    });
+                });
+            }
+            else {
+                std::vector<unsigned int> results(nTasks);
+                forEachSlice([&](std::span<const Task> slice, size_t offset) {
+                    Exec::ParallelTransform(slice, std::span{ results }.subspan(offset, slice.size()), computeTask);
+                });
+            }
         }
         catch (...) {
             std::cout << "yikes" << std::endl;
         }
+        std::cout << "Time taken: " << timer.Peek() << std::endl;
+        Finish();
+        return 0;
+    }
+    // the watchdog cancels everything still queued on both pools once the budget runs out
+    size_t dropped = 0;
+    float cancelledAt = 0.f;
+    std::jthread watchdog;
+    if (Budget > 0) {
+        watchdog = std::jthread([&](std::stop_token st) {
+            std::mutex mtx;
+            std::condition_variable_any cv;
+            std::unique_lock lk{ mtx };
+            cv.wait_for(lk, st, 1ms * Budget, [] { return false; });
+            if (!st.stop_requested()) {
+                cancelledAt = timer.Peek();
+                budgetStop.request_stop();
+                dropped = Exec::AsyncPool().CancelPending() + Exec::ComputePool().CancelPending();
+            }
+        });
+    }
+    // built once, then run for every item
+    struct GraphItem
+    {
+        const Task* task;
+    };
+    tk::Graph<GraphItem> itemGraph;
+    if (Pipeline == "graph") {
+        const auto fetch = itemGraph.Add(Exec::AsyncPool(), [&](GraphItem&) { asyncTask(); });
+        itemGraph.Add(Exec::ComputePool(), [&](GraphItem& item) { computeTask(*item.task); }, { fetch },
+            [&](const GraphItem& item) { return computeCost(*item.task); });
+    }
+    // one group for the whole run: every chain counts until its compute step has finished
+    tk::TaskGroup group;
+    const auto submit = [&](const Task& workItem) {
+        if (Pipeline == "coro") {
+            group.Track(tk::Spawn(coroTask(workItem)));
+        }
+        else if (Pipeline == "graph") {
+            group.Track(itemGraph.Run({ &workItem }));
+        }
+        else if (Pipeline == "blocking") {
+            // the compute step is spawned from inside the async member
+            Exec::AsyncIn(group, [&] {
+                asyncTask();
+                Exec::ComputeIn(group, [&] { computeTask(workItem); }, computeCost(workItem));
+            });
+        }
+        else {
+            group.Track(Exec::Delay(1ms * AsyncSleep).Then(Exec::ComputePool(), computeCost(workItem), [&] {
+                return computeTask(workItem);
+            }));
+        }
+    };
+    // streamed chunks are kept until the end, the chains refer to their items in place
+    std::deque<Dataset> chunks;
+    if (streamed) {
+        DatasetStream stream{ DatasetSpec::FromCli(DatasetKind) };
+        for (auto chunk = stream.Next(); !chunk.empty(); chunk = stream.Next()) {
+            for (const Task& workItem : chunks.emplace_back(std::move(chunk))) {
+                submit(workItem);
+            }
+        }
+    }
+    else {
+        forEachSlice([&](std::span<const Task> slice, size_t) {
+            for (const Task& workItem : slice) {
+                submit(workItem);
+            }
+        });
+    }
+    try {
+        group.Wait();
+    }
+    catch (const tk::Cancelled&) {
+        std::cout << "Over budget, remaining work was cancelled" << std::endl;
+    }
+    catch (...) {
+        std::cout << "yikes" << std::endl;
     }
     auto time = timer.Peek();
+    watchdog = {};
+    if (overBudget.stop_requested()) {
+        std::cout << "Cancelled at " << cancelledAt << "s: dropped " << dropped << " queued tasks, quiescent "
+            << (time - cancelledAt) * 1000.f << "ms later" << std::endl;
+    }
 
     std::cout << "Time taken: " << time << std::endl;
+    if (const auto stats = tk::Timer::Default().GetStats(); stats.fired > 0) {
+        std::cout << "Timer fired: " << stats.fired << ", lateness ms mean/p99/max: "
+            << stats.meanLateness << " / " << stats.p99Lateness << " / " << stats.maxLateness << std::endl;
+    }
+    Finish();
 
     return 0;
 }
\ No newline at end of file